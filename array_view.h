@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Non-owning view over a contiguous read-only array.
+template <typename T>
+class ArrayView
+{
+    public:
+        ArrayView() : _Data(nullptr), _Size(0) {};
+        ArrayView(const T *data, std::size_t size) : _Data(data), _Size(size) {};
+        ArrayView(const std::vector<T> &v) : _Data(v.data()), _Size(v.size()) {};
+
+        const T &operator[](std::size_t i) const { return _Data[i]; }
+
+        const T *data() const     { return _Data; }
+        std::size_t size() const  { return _Size; }
+        bool empty() const        { return _Size == 0; }
+        const T *begin() const    { return _Data; }
+        const T *end() const      { return _Data + _Size; }
+
+    private:
+        const T *_Data;
+        std::size_t _Size;
+};
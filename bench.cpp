@@ -0,0 +1,426 @@
+// Micro-benchmarks of the renderer hot paths.
+//
+// Every benchmark prints one JSON object per line:
+//   {"name": ..., "params": {...}, "reps": N, "seconds": best, "metric": unit, "value": throughput}
+// 'seconds' is the best of --reps repetitions, each of which runs the kernel
+// for at least --min-time seconds. Inputs are generated from a fixed seed, so
+// runs are comparable between builds.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "deferred_renderer.h"
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "obj_model.h"
+#include "rasterizer.h"
+#include "tgaimage.h"
+
+// Results of kernels that have no other side effect end up here, so the
+// optimizer can not drop the work.
+static volatile unsigned long bench_sink;
+
+struct BenchOptions
+{
+    BenchOptions() : faces(200000), width(800), height(800), bpp(3), triangle_size(16),
+                     reps(5), min_time(0.2), filter(), temp_dir("/tmp") {};
+
+    unsigned long faces;
+    int width;
+    int height;
+    int bpp;
+    long triangle_size;
+    int reps;
+    double min_time;
+    std::string filter;
+    std::string temp_dir;
+};
+
+static
+bool parse_options(int argc, char **argv, BenchOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (arg == "--faces")            options.faces = std::strtoul(value, nullptr, 10);
+        else if (arg == "--width")       options.width = std::atoi(value);
+        else if (arg == "--height")      options.height = std::atoi(value);
+        else if (arg == "--bpp")         options.bpp = std::atoi(value);
+        else if (arg == "--tri-size")    options.triangle_size = std::atol(value);
+        else if (arg == "--reps")        options.reps = std::atoi(value);
+        else if (arg == "--min-time")    options.min_time = std::atof(value);
+        else if (arg == "--filter")      options.filter = value;
+        else if (arg == "--temp-dir")    options.temp_dir = value;
+        else                             return false;
+    }
+    return options.faces > 0 && options.width > 0 && options.height > 0 && options.reps > 0
+        && (options.bpp == TGAImage::GRAYSCALE || options.bpp == TGAImage::RGB || options.bpp == TGAImage::RGBA);
+}
+
+// Runs 'kernel' until 'min_time' has passed, 'reps' times, and prints the
+// best rate. 'kernel' returns the amount of work done in 'metric' units
+// (before the per-second division, e.g. bytes for MB/s).
+static
+void run(const BenchOptions &options, const std::string &name, const std::string &params,
+         const std::string &metric, double unit, const std::function<double()> &kernel)
+{
+    if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+    {
+        return;
+    }
+
+    double best_rate = 0;
+    double best_seconds = 0;
+    for (int rep = 0; rep < options.reps; rep++)
+    {
+        double work = 0;
+        double seconds = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        do
+        {
+            work += kernel();
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (seconds < options.min_time);
+
+        double rate = work / unit / seconds;
+        if (rate > best_rate)
+        {
+            best_rate = rate;
+            best_seconds = seconds;
+        }
+    }
+
+    std::printf("{\"name\": \"%s\", \"params\": {%s}, \"reps\": %d, \"seconds\": %.6f, \"metric\": \"%s\", \"value\": %.3f}\n",
+                name.c_str(), params.c_str(), options.reps, best_seconds, metric.c_str(), best_rate);
+    std::fflush(stdout);
+}
+
+static
+std::string image_params(const BenchOptions &options)
+{
+    std::ostringstream out;
+    out << "\"width\": " << options.width << ", \"height\": " << options.height << ", \"bpp\": " << options.bpp;
+    return out.str();
+}
+
+// Noisy image with runs, so the RLE paths see both raw and run packets.
+static
+void fill_image(TGAImage &image, std::mt19937 &random)
+{
+    unsigned char *data = image.buffer();
+    std::size_t nbytes = (std::size_t)image.get_width() * image.get_height() * image.get_bytespp();
+    std::size_t i = 0;
+    while (i < nbytes)
+    {
+        std::size_t run = std::min<std::size_t>(1 + random() % 32, nbytes - i);
+        bool solid = random() % 2;
+        unsigned char value = random();
+        for (std::size_t k = 0; k < run; k++, i++)
+        {
+            data[i] = solid ? value : (unsigned char)random();
+        }
+    }
+}
+
+// Writes a grid mesh of about 'faces' triangles.
+static
+std::string write_mesh(const BenchOptions &options, std::mt19937 &random)
+{
+    std::string path = options.temp_dir + "/bench_mesh.obj";
+    std::ofstream out(path.c_str());
+    unsigned long side = std::max(2UL, (unsigned long)std::sqrt(options.faces / 2.) + 1);
+    std::uniform_real_distribution<float> jitter(-0.001f, 0.001f);
+    for (unsigned long y = 0; y < side; y++)
+    {
+        for (unsigned long x = 0; x < side; x++)
+        {
+            float fx = 2.f * x / (side - 1) - 1.f;
+            float fy = 2.f * y / (side - 1) - 1.f;
+            out << "v " << fx << " " << fy << " " << jitter(random) << "\n";
+            out << "vt " << (fx + 1) / 2 << " " << (fy + 1) / 2 << " 0.0\n";
+            out << "vn 0.0 0.0 1.0\n";
+        }
+    }
+    unsigned long written = 0;
+    for (unsigned long y = 0; y + 1 < side && written < options.faces; y++)
+    {
+        for (unsigned long x = 0; x + 1 < side && written < options.faces; x++)
+        {
+            unsigned long a = y * side + x + 1, b = a + 1, c = a + side, d = c + 1;
+            out << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/" << b << " "
+                << d << "/" << d << "/" << d << "\n";
+            out << "f " << a << "/" << a << "/" << a << " " << d << "/" << d << "/" << d << " "
+                << c << "/" << c << "/" << c << "\n";
+            written += 2;
+        }
+    }
+    return path;
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions options;
+    if (!parse_options(argc, argv, options))
+    {
+        std::cerr << "Usage: " << argv[0] << " [--faces N] [--width W] [--height H] [--bpp 1|3|4]"
+                  << " [--tri-size PIXELS] [--reps N] [--min-time SECONDS] [--filter NAME] [--temp-dir DIR]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::mt19937 random(1);
+    // the TGA reader reports every load on stderr
+    std::cerr.setstate(std::ios::failbit);
+
+    const std::size_t image_bytes = (std::size_t)options.width * options.height * options.bpp;
+    const double pixels = (double)options.width * options.height;
+
+    // OBJ parsing
+    {
+        std::string mesh_path = write_mesh(options, random);
+        std::ifstream in(mesh_path.c_str(), std::ios::binary | std::ios::ate);
+        double file_bytes = in.tellg();
+        std::size_t faces = ObjModel(mesh_path.c_str(), false).GetFacesCount();
+        std::ostringstream params;
+        params << "\"faces\": " << faces;
+        run(options, "obj_parse", params.str(), "faces/s", 1, [&]() {
+            ObjModel model(mesh_path.c_str(), false);
+            return (double)model.GetFacesCount();
+        });
+        run(options, "obj_parse_bytes", params.str(), "MB/s", 1e6, [&]() {
+            ObjModel model(mesh_path.c_str(), false);
+            return file_bytes;
+        });
+        std::remove(mesh_path.c_str());
+    }
+
+    // Vertex transform
+    {
+        std::uniform_real_distribution<float> unit_dist(-1.f, 1.f);
+        Vector3Array points;
+        points.resize(options.faces);
+        for (std::size_t i = 0; i < points.size(); i++)
+        {
+            points.x[i] = unit_dist(random);
+            points.y[i] = unit_dist(random);
+            points.z[i] = unit_dist(random);
+        }
+        Matrix4 to_screen = Matrix4::viewport(0, 0, options.width, options.height, 255) * Matrix4::perspective(3, 1.25f, 4.75f) *
+                            Matrix4::look_at(Vector3f(1, 1, 3), Vector3f(), Vector3f(0, 1, 0)) * Matrix4::rotation_y(0.5f);
+        Vector3Array transformed;
+        std::ostringstream params;
+        params << "\"vertices\": " << points.size();
+        run(options, "vertex_transform", params.str(), "vertices/s", 1, [&]() {
+            transform_points(to_screen, points, transformed);
+            return (double)points.size();
+        });
+    }
+
+    // Rasterization
+    {
+        std::string texture_path = options.temp_dir + "/bench_texture.tga";
+        TGAImage texture(256, 256, TGAImage::RGB);
+        fill_image(texture, random);
+        texture.write_tga_file(texture_path.c_str());
+        Texture diffuse;
+        diffuse.Load(texture_path.c_str());
+
+        TGAImage image(options.width, options.height, TGAImage::RGB);
+        DepthBuffer zbuffer(options.width, options.height);
+        Vector3f light(0, 0, 1);
+        Rect screen(0, 0, options.width, options.height);
+
+        std::uniform_int_distribution<long> x_dist(0, options.width - 1);
+        std::uniform_int_distribution<long> y_dist(0, options.height - 1);
+        std::uniform_int_distribution<long> d_dist(-options.triangle_size, options.triangle_size);
+        std::uniform_int_distribution<long> z_dist(0, 255);
+        std::vector<ScreenTriangle> triangles(4096);
+        for (ScreenTriangle &t : triangles)
+        {
+            long cx = x_dist(random), cy = y_dist(random);
+            for (int k = 0; k < 3; k++)
+            {
+                t.v[k] = Vector3l(cx + d_dist(random), cy + d_dist(random), z_dist(random));
+                t.p[k] = Vector2l(t.v[k].x * SUBPIXEL_SCALE, t.v[k].y * SUBPIXEL_SCALE);
+                t.n[k] = Vector3f(0, 0, 1);
+                t.u[k] = Vector2l(x_dist(random) % 256, y_dist(random) % 256);
+            }
+        }
+
+        std::ostringstream params;
+        params << image_params(options) << ", \"tri_size\": " << options.triangle_size;
+        const char *names[] = {"triangle_scanline", "triangle_edge", "triangle_fixed"};
+        const RasterMode modes[] = {RASTER_SCANLINE, RASTER_EDGE, RASTER_FIXED};
+        for (int m = 0; m < 3; m++)
+        {
+            run(options, names[m], params.str(), "triangles/s", 1, [&]() {
+                zbuffer.Clear();
+                for (const ScreenTriangle &t : triangles)
+                {
+                    rasterize(modes[m], image, t, zbuffer, diffuse, light, screen);
+                }
+                return (double)triangles.size();
+            });
+        }
+
+        // Forward against deferred shading where triangles overlap a lot:
+        // twice larger triangles in the middle half of the screen, sampled
+        // trilinearly so that shading costs what it does with --mipmaps.
+        {
+            Texture mipmapped_diffuse;
+            mipmapped_diffuse.Load(texture_path.c_str(), true);
+            std::uniform_int_distribution<long> cx_dist(options.width / 4, options.width * 3 / 4);
+            std::uniform_int_distribution<long> cy_dist(options.height / 4, options.height * 3 / 4);
+            std::uniform_int_distribution<long> large_dist(-2 * options.triangle_size, 2 * options.triangle_size);
+            std::vector<ScreenTriangle> stacked(triangles);
+            double covered = 0;
+            for (ScreenTriangle &t : stacked)
+            {
+                long cx = cx_dist(random), cy = cy_dist(random);
+                for (int k = 0; k < 3; k++)
+                {
+                    t.v[k].x = cx + large_dist(random);
+                    t.v[k].y = cy + large_dist(random);
+                    t.p[k] = Vector2l(t.v[k].x * SUBPIXEL_SCALE, t.v[k].y * SUBPIXEL_SCALE);
+                }
+                covered += std::abs((double)((t.v[1].x - t.v[0].x) * (t.v[2].y - t.v[0].y) -
+                                             (t.v[1].y - t.v[0].y) * (t.v[2].x - t.v[0].x))) / 2;
+            }
+
+            std::ostringstream stacked_params;
+            stacked_params << params.str() << ", \"depth_complexity\": "
+                           << covered / ((options.width / 2) * (options.height / 2) + 1);
+            run(options, "overdraw_forward", stacked_params.str(), "triangles/s", 1, [&]() {
+                zbuffer.Clear();
+                for (const ScreenTriangle &t : stacked)
+                {
+                    rasterize(RASTER_FIXED, image, t, zbuffer, mipmapped_diffuse, light, screen);
+                }
+                return (double)stacked.size();
+            });
+
+            ThreadPool pool(1);
+            DeferredRenderer deferred(pool, options.width, options.height);
+            std::vector<const Texture *> stacked_textures(stacked.size(), &mipmapped_diffuse);
+            run(options, "overdraw_deferred", stacked_params.str(), "triangles/s", 1, [&]() {
+                zbuffer.Clear();
+                deferred.Render(image, zbuffer, light, stacked, stacked_textures);
+                return (double)stacked.size();
+            });
+        }
+
+        run(options, "texture_sample", "\"texture\": 256", "texels/s", 1, [&]() {
+            unsigned long sum = 0;
+            for (long y = 0; y < 256; y++)
+            {
+                for (long x = 0; x < 256; x++)
+                {
+                    // walk the texture diagonally, like a rotated triangle does
+                    sum += diffuse.Fetch((x + y) & 255, (y * 3 + x) & 255);
+                }
+            }
+            bench_sink = sum;
+            return 65536.;
+        });
+
+        Texture mipmapped;
+        mipmapped.Load(texture, true);
+        run(options, "texture_sample_trilinear", "\"texture\": 256, \"lod\": 1.5", "texels/s", 1, [&]() {
+            unsigned long sum = 0;
+            for (long y = 0; y < 256; y++)
+            {
+                for (long x = 0; x < 256; x++)
+                {
+                    sum += mipmapped.Sample((x + y) & 255, (y * 3 + x) & 255, 1.5f).val;
+                }
+            }
+            bench_sink = sum;
+            return 65536.;
+        });
+
+        run(options, "line", image_params(options), "pixels/s", 1, [&]() {
+            double drawn = 0;
+            for (const ScreenTriangle &t : triangles)
+            {
+                int x0 = std::min(std::max(t.v[0].x, 0L), (long)options.width - 1);
+                int y0 = std::min(std::max(t.v[0].y, 0L), (long)options.height - 1);
+                int x1 = std::min(std::max(t.v[1].x, 0L), (long)options.width - 1);
+                int y1 = std::min(std::max(t.v[1].y, 0L), (long)options.height - 1);
+                line(image, x0, y0, x1, y1, TGAColor(255, 255, 255, 255));
+                drawn += std::max(std::abs(x1 - x0), std::abs(y1 - y0));
+            }
+            return drawn;
+        });
+
+        std::remove(texture_path.c_str());
+    }
+
+    // TGA files and image operations
+    {
+        TGAImage image(options.width, options.height, options.bpp);
+        fill_image(image, random);
+        std::string raw_path = options.temp_dir + "/bench_raw.tga";
+        std::string rle_path = options.temp_dir + "/bench_rle.tga";
+        image.write_tga_file(raw_path.c_str(), false);
+        image.write_tga_file(rle_path.c_str(), true);
+
+        run(options, "tga_write_raw", image_params(options), "MB/s", 1e6, [&]() {
+            image.write_tga_file(raw_path.c_str(), false);
+            return (double)image_bytes;
+        });
+        run(options, "tga_rle_encode", image_params(options), "MB/s", 1e6, [&]() {
+            image.write_tga_file(rle_path.c_str(), true);
+            return (double)image_bytes;
+        });
+        run(options, "tga_read_raw", image_params(options), "MB/s", 1e6, [&]() {
+            TGAImage loaded;
+            loaded.read_tga_file(raw_path.c_str());
+            return (double)image_bytes;
+        });
+        run(options, "tga_rle_decode", image_params(options), "MB/s", 1e6, [&]() {
+            TGAImage loaded;
+            loaded.read_tga_file(rle_path.c_str());
+            return (double)image_bytes;
+        });
+        run(options, "flip_horizontally", image_params(options), "MB/s", 1e6, [&]() {
+            image.flip_horizontally();
+            return (double)image_bytes;
+        });
+        run(options, "scale_half", image_params(options), "pixels/s", 1, [&]() {
+            TGAImage scaled(image);
+            scaled.scale(options.width / 2, options.height / 2);
+            return pixels;
+        });
+        const char *filter_names[] = {"scale_half_box", "scale_half_bilinear", "scale_half_bicubic"};
+        const TGAImage::Filter filters[] = {TGAImage::BOX, TGAImage::BILINEAR, TGAImage::BICUBIC};
+        for (int f = 0; f < 3; f++)
+        {
+            run(options, filter_names[f], image_params(options), "pixels/s", 1, [&]() {
+                TGAImage scaled(image);
+                scaled.scale(options.width / 2, options.height / 2, filters[f]);
+                return pixels;
+            });
+        }
+
+        std::remove(raw_path.c_str());
+        std::remove(rle_path.c_str());
+    }
+
+    return 0;
+}
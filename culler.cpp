@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cmath>
+
+#include "culler.h"
+#include "profiler.h"
+
+namespace
+{
+
+// Rounding towards -infinity, for b > 0.
+inline long floor_div(long a, long b)
+{
+    return a >= 0 ? a / b : -((b - 1 - a) / b);
+}
+
+// True when a pixel centre, x + 1/2 and y + 1/2, lies inside the bounding box
+// of the subpixel positions 'p'. Triangles failing this are sub-pixel: they
+// fall between the sample points and the fixed-point rasterizer would not
+// draw anything.
+bool covers_pixel_centre(const std::array<Vector2l, 3> &p)
+{
+    const long half = SUBPIXEL_SCALE / 2;
+    long min_x = std::min(p[0].x, std::min(p[1].x, p[2].x)) - half;
+    long max_x = std::max(p[0].x, std::max(p[1].x, p[2].x)) - half;
+    long min_y = std::min(p[0].y, std::min(p[1].y, p[2].y)) - half;
+    long max_y = std::max(p[0].y, std::max(p[1].y, p[2].y)) - half;
+    // ceil(min / scale) <= floor(max / scale) on both axes
+    return -floor_div(-min_x, SUBPIXEL_SCALE) <= floor_div(max_x, SUBPIXEL_SCALE) &&
+           -floor_div(-min_y, SUBPIXEL_SCALE) <= floor_div(max_y, SUBPIXEL_SCALE);
+}
+
+// Triangle corner with every attribute widened, so that the clipped
+// vertices are interpolated without intermediate rounding.
+struct ClipVertex
+{
+    double v[3];
+    double p[2];
+    double n[3];
+    double u[2];
+};
+
+ClipVertex make_clip_vertex(const ScreenTriangle &t, int k)
+{
+    ClipVertex c;
+    c.v[0] = t.v[k].x;
+    c.v[1] = t.v[k].y;
+    c.v[2] = t.v[k].z;
+    c.p[0] = t.p[k].x;
+    c.p[1] = t.p[k].y;
+    c.n[0] = t.n[k].x;
+    c.n[1] = t.n[k].y;
+    c.n[2] = t.n[k].z;
+    c.u[0] = t.u[k].x;
+    c.u[1] = t.u[k].y;
+    return c;
+}
+
+ClipVertex lerp(const ClipVertex &a, const ClipVertex &b, double s)
+{
+    ClipVertex c;
+    for (int i = 0; i < 3; i++)
+    {
+        c.v[i] = a.v[i] + (b.v[i] - a.v[i]) * s;
+        c.n[i] = a.n[i] + (b.n[i] - a.n[i]) * s;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        c.p[i] = a.p[i] + (b.p[i] - a.p[i]) * s;
+        c.u[i] = a.u[i] + (b.u[i] - a.u[i]) * s;
+    }
+    return c;
+}
+
+// Plane 'sign' * coordinate + 'offset' >= 0. Axes 0 and 1 are x and y of
+// the subpixel position, axis 2 is the depth.
+struct ClipPlane
+{
+    int axis;
+    double sign;
+    double offset;
+
+    double Distance(const ClipVertex &c) const
+    {
+        return sign * (axis == 2 ? c.v[2] : c.p[axis]) + offset;
+    }
+};
+
+// A triangle clipped by 6 planes has at most 9 corners.
+const int MAX_CLIP_VERTICES = 9;
+
+}
+
+TriangleCuller::TriangleCuller(const Rect &screen, long depth, bool cull_back_faces)
+    : _Screen(screen),
+      _GuardBand(screen.x0 - GUARD_BAND, screen.y0 - GUARD_BAND, screen.x1 + GUARD_BAND, screen.y1 + GUARD_BAND),
+      _Depth(depth), _CullBackFaces(cull_back_faces)
+{
+}
+
+void TriangleCuller::Process(const ScreenTriangle &t, RasterMode mode, std::vector<ScreenTriangle> &out) const
+{
+    // The winding comes from the positions the rasterizer for 'mode' uses,
+    // so a triangle it would find degenerate is never passed on.
+    long area;
+    if (mode == RASTER_FIXED)
+    {
+        area = (t.p[1].x - t.p[0].x) * (t.p[2].y - t.p[0].y) - (t.p[1].y - t.p[0].y) * (t.p[2].x - t.p[0].x);
+    }
+    else
+    {
+        area = (t.v[1].x - t.v[0].x) * (t.v[2].y - t.v[0].y) - (t.v[1].y - t.v[0].y) * (t.v[2].x - t.v[0].x);
+    }
+    if (area == 0)
+    {
+        PROFILE_COUNT(TRIANGLES_DEGENERATE, 1);
+        return;
+    }
+    if (_CullBackFaces && area < 0)
+    {
+        PROFILE_COUNT(TRIANGLES_BACKFACING, 1);
+        return;
+    }
+
+    long z_min = std::min(t.v[0].z, std::min(t.v[1].z, t.v[2].z));
+    long z_max = std::max(t.v[0].z, std::max(t.v[1].z, t.v[2].z));
+    Rect bounds = get_bounds(t, mode);
+    if (z_max < 0 || z_min > _Depth || bounds.x1 <= _Screen.x0 || bounds.y1 <= _Screen.y0 ||
+        bounds.x0 >= _Screen.x1 || bounds.y0 >= _Screen.y1 ||
+        (mode == RASTER_FIXED && !covers_pixel_centre(t.p)))
+    {
+        PROFILE_COUNT(TRIANGLES_CULLED, 1);
+        return;
+    }
+
+    bool inside = z_min >= 0 && z_max <= _Depth;
+    for (int k = 0; k < 3 && inside; k++)
+    {
+        inside = t.p[k].x >= _GuardBand.x0 * SUBPIXEL_SCALE && t.p[k].x <= _GuardBand.x1 * SUBPIXEL_SCALE &&
+                 t.p[k].y >= _GuardBand.y0 * SUBPIXEL_SCALE && t.p[k].y <= _GuardBand.y1 * SUBPIXEL_SCALE;
+    }
+    if (inside)
+    {
+        out.push_back(t);
+        return;
+    }
+    PROFILE_COUNT(TRIANGLES_CLIPPED, 1);
+    Clip(t, out);
+}
+
+// Sutherland-Hodgman against the guard band and the depth range, then the
+// polygon is split into a fan, which keeps the winding.
+void TriangleCuller::Clip(const ScreenTriangle &t, std::vector<ScreenTriangle> &out) const
+{
+    const ClipPlane planes[6] = {
+        {0, 1., -(double)_GuardBand.x0 * SUBPIXEL_SCALE}, {0, -1., (double)_GuardBand.x1 * SUBPIXEL_SCALE},
+        {1, 1., -(double)_GuardBand.y0 * SUBPIXEL_SCALE}, {1, -1., (double)_GuardBand.y1 * SUBPIXEL_SCALE},
+        {2, 1., 0.}, {2, -1., (double)_Depth}
+    };
+
+    ClipVertex polygon[MAX_CLIP_VERTICES];
+    ClipVertex clipped[MAX_CLIP_VERTICES];
+    int count = 3;
+    for (int k = 0; k < 3; k++)
+    {
+        polygon[k] = make_clip_vertex(t, k);
+    }
+    for (const ClipPlane &plane : planes)
+    {
+        int clipped_count = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const ClipVertex &a = polygon[i];
+            const ClipVertex &b = polygon[(i + 1) % count];
+            double da = plane.Distance(a);
+            double db = plane.Distance(b);
+            if (da >= 0)
+            {
+                clipped[clipped_count++] = a;
+            }
+            if ((da >= 0) != (db >= 0))
+            {
+                clipped[clipped_count++] = lerp(a, b, da / (da - db));
+            }
+        }
+        std::copy(clipped, clipped + clipped_count, polygon);
+        count = clipped_count;
+        if (count < 3)
+        {
+            return;
+        }
+    }
+
+    ScreenTriangle corners;
+    for (int i = 0; i < count; i++)
+    {
+        const ClipVertex &c = polygon[i];
+        int k = std::min(i, 2);
+        corners.v[k] = Vector3l(std::lround(c.v[0]), std::lround(c.v[1]), std::lround(c.v[2]));
+        corners.p[k] = Vector2l(std::lround(c.p[0]), std::lround(c.p[1]));
+        corners.n[k] = Vector3f(c.n[0], c.n[1], c.n[2]);
+        corners.u[k] = Vector2l(std::lround(c.u[0]), std::lround(c.u[1]));
+        if (i >= 2)
+        {
+            out.push_back(corners);
+            // the next triangle of the fan shares corner 0 and this corner
+            corners.v[1] = corners.v[2];
+            corners.p[1] = corners.p[2];
+            corners.n[1] = corners.n[2];
+            corners.u[1] = corners.u[2];
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include "rasterizer.h"
+
+// Culling and clipping between the vertex stage and the rasterizers.
+//
+// Triangles that can not cover a pixel centre are dropped here instead of
+// pixel by pixel: zero-area and sub-pixel ones, those entirely outside the
+// screen or the [0, depth] range, and back-facing ones when enabled. The rest
+// is clipped against the depth range and a guard band GUARD_BAND pixels
+// around the screen. Between the screen and the guard band the rasterizers'
+// scissor is cheaper than clipping, so only the rare triangles reaching past
+// it are split, which keeps the edge and attribute arithmetic in range.
+class TriangleCuller
+{
+    public:
+        static const long GUARD_BAND = 2048;
+
+        TriangleCuller(const Rect &screen, long depth, bool cull_back_faces = true);
+
+        // Appends what is left of 't' for rasterization in 'mode' to 'out':
+        // nothing, 't' itself, or the fan of its clipped polygon.
+        void Process(const ScreenTriangle &t, RasterMode mode, std::vector<ScreenTriangle> &out) const;
+
+    private:
+        void Clip(const ScreenTriangle &t, std::vector<ScreenTriangle> &out) const;
+
+        Rect _Screen;
+        Rect _GuardBand;
+        long _Depth;
+        bool _CullBackFaces;
+};
@@ -0,0 +1,60 @@
+#include <algorithm>
+#include "deferred_renderer.h"
+
+namespace
+{
+
+// Triangles per task of the shading setup.
+const std::size_t SETUP_BATCH = 1024;
+
+}
+
+DeferredRenderer::DeferredRenderer(ThreadPool &pool, long width, long height, long tile_size)
+    : _Tiles(pool, width, height, tile_size), _Visibility(width, height)
+{
+}
+
+void DeferredRenderer::Render(TGAImage &image, DepthBuffer &zbuffer, const Vector3f &light,
+                              const std::vector<ScreenTriangle> &triangles, const std::vector<const Texture *> &textures)
+{
+    ThreadPool &pool = _Tiles.GetPool();
+
+    pool.ParallelFor(_Tiles.GetTilesCount(), [&](std::size_t tile)
+    {
+        Rect rect = _Tiles.GetTileRect(tile);
+        _Visibility.Clear(rect.x0, rect.y0, rect.x1, rect.y1);
+    });
+    if (pool.GetThreadsCount() > 1)
+    {
+        _Tiles.ForEachTile(triangles, RASTER_FIXED, [&](unsigned index, const Rect &clip)
+        {
+            triangle_visibility(triangles[index], index, zbuffer, _Visibility, light, clip);
+        });
+    }
+    else
+    {
+        // binning only pays off when the tiles run in parallel
+        Rect screen(0, 0, _Visibility.GetWidth(), _Visibility.GetHeight());
+        for (std::size_t i = 0; i < triangles.size(); i++)
+        {
+            triangle_visibility(triangles[i], i, zbuffer, _Visibility, light, screen);
+        }
+    }
+
+    // the setup is per triangle rather than per pixel, so it is done for all
+    // of them instead of tracking which ones ended up visible
+    _Setups.resize(triangles.size());
+    pool.ParallelFor((triangles.size() + SETUP_BATCH - 1) / SETUP_BATCH, [&](std::size_t batch)
+    {
+        std::size_t end = std::min(triangles.size(), (batch + 1) * SETUP_BATCH);
+        for (std::size_t i = batch * SETUP_BATCH; i < end; i++)
+        {
+            _Setups[i] = setup_shading(triangles[i], *textures[i]);
+        }
+    });
+
+    pool.ParallelFor(_Tiles.GetTilesCount(), [&](std::size_t tile)
+    {
+        shade_visibility(image, _Visibility, _Setups, light, _Tiles.GetTileRect(tile));
+    });
+}
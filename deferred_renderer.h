@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include "rasterizer.h"
+#include "tile_renderer.h"
+#include "visibility_buffer.h"
+
+// Two-pass rendering through a visibility buffer. The depth pass runs the
+// fixed-point rasterizer for depth and triangle ids only; the shading pass
+// then interpolates, fetches and lights every visible pixel exactly once, so
+// fragments a nearer triangle overwrites later cost no shading. The image is
+// identical to the one RASTER_FIXED draws. Both passes are split into the
+// tiles of a TileRenderer and run on its thread pool; a pool of one thread
+// draws the depth pass unbinned.
+class DeferredRenderer
+{
+    public:
+        DeferredRenderer(ThreadPool &pool, long width, long height, long tile_size = 64);
+
+        // Draws 'triangles[i]' with the texture 'textures[i]'.
+        void Render(TGAImage &image, DepthBuffer &zbuffer, const Vector3f &light,
+                    const std::vector<ScreenTriangle> &triangles, const std::vector<const Texture *> &textures);
+
+    private:
+        TileRenderer _Tiles;
+        VisibilityBuffer _Visibility;
+        std::vector<ShadingSetup> _Setups;
+};
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "depth_buffer.h"
+
+static const std::size_t DEPTH_ALIGNMENT = 64;
+
+DepthBuffer::DepthBuffer(long width, long height, Format format)
+    : _Width(width), _Height(height), _Format(format), _Epoch(1)
+{
+    _BlocksX = (_Width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    long blocks_y = (_Height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    std::size_t nbytes = (std::size_t)_Width * _Height * _Format;
+    _Allocation = new unsigned char[nbytes + DEPTH_ALIGNMENT];
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(_Allocation);
+    _Data = _Allocation + (DEPTH_ALIGNMENT - address % DEPTH_ALIGNMENT) % DEPTH_ALIGNMENT;
+
+    // Epoch 0 never matches the current epoch, so every block starts cleared.
+    _BlockEpoch.assign(_BlocksX * blocks_y, 0);
+}
+
+DepthBuffer::~DepthBuffer()
+{
+    delete [] _Allocation;
+}
+
+long DepthBuffer::GetMaxDepth() const
+{
+    switch (_Format)
+    {
+        case DEPTH16:
+            return Depth16::MAX_DEPTH;
+        case DEPTH24:
+            return Depth24::MAX_DEPTH;
+        default:
+            return Depth32F::MAX_DEPTH;
+    }
+}
+
+void DepthBuffer::ResetBlock(std::size_t block)
+{
+    long x0 = (block % _BlocksX) * BLOCK_SIZE;
+    long y0 = (block / _BlocksX) * BLOCK_SIZE;
+    long x1 = std::min(x0 + BLOCK_SIZE, _Width);
+    long y1 = std::min(y0 + BLOCK_SIZE, _Height);
+    for (long y = y0; y < y1; y++)
+    {
+        if (_Format == DEPTH32F)
+        {
+            std::fill((float *)_Data + y * _Width + x0, (float *)_Data + y * _Width + x1, (float)CLEARED);
+        }
+        else
+        {
+            // CLEARED is stored as 0 in the integer formats.
+            std::memset(_Data + (y * _Width + x0) * _Format, 0, (x1 - x0) * _Format);
+        }
+    }
+    _BlockEpoch[block] = _Epoch;
+}
+
+void DepthBuffer::Clear()
+{
+    _Epoch++;
+    if (_Epoch == 0)
+    {
+        // The counter wrapped and old tags may look current again.
+        Fill();
+    }
+}
+
+void DepthBuffer::Fill()
+{
+    std::size_t npixels = (std::size_t)_Width * _Height;
+    if (_Format == DEPTH32F)
+    {
+        std::fill((float *)_Data, (float *)_Data + npixels, (float)CLEARED);
+    }
+    else
+    {
+        std::memset(_Data, 0, npixels * _Format);
+    }
+    if (_Epoch == 0)
+    {
+        _Epoch = 1;
+    }
+    std::fill(_BlockEpoch.begin(), _BlockEpoch.end(), _Epoch);
+}
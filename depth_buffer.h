@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Depth buffer with compact storage. Depths are integers in
+// [0, GetMaxDepth()]; larger values are nearer. A cleared pixel reads as
+// CLEARED, which is farther than any storable depth.
+//
+// Clear() is O(1): every BLOCK_SIZE x BLOCK_SIZE block carries the epoch it
+// was last written in, and a block from an older epoch reads as cleared until
+// its first write resets it.
+class DepthBuffer
+{
+    public:
+        enum Format
+        {
+            DEPTH16 = 2, DEPTH24 = 3, DEPTH32F = 4
+        };
+
+        static const long CLEARED = -1;
+        static const long BLOCK_SIZE = 8;
+
+        DepthBuffer(long width, long height, Format format = DEPTH16);
+        ~DepthBuffer();
+
+        DepthBuffer(const DepthBuffer &) = delete;
+        DepthBuffer &operator=(const DepthBuffer &) = delete;
+
+        long GetWidth() const    { return _Width; }
+        long GetHeight() const   { return _Height; }
+        Format GetFormat() const { return _Format; }
+        long GetMaxDepth() const;
+
+        // Resolve the format on every call; loops over many pixels should
+        // go through a Depth view instead.
+        inline long Get(long x, long y) const;
+        inline void Set(long x, long y, long depth);
+
+        // Lazy clear through the block epochs.
+        void Clear();
+        // Eager clear of the whole storage with a bulk fill.
+        void Fill();
+
+    private:
+        template <class DepthFormat> friend class Depth;
+
+        std::size_t GetBlock(long x, long y) const { return (y / BLOCK_SIZE) * _BlocksX + x / BLOCK_SIZE; }
+        void ResetBlock(std::size_t block);
+        inline long Load(std::size_t offset) const;
+        inline void Store(std::size_t offset, long depth);
+
+        long _Width;
+        long _Height;
+        long _BlocksX;
+        Format _Format;
+
+        unsigned char *_Allocation;
+        unsigned char *_Data;
+
+        std::vector<std::uint32_t> _BlockEpoch;
+        std::uint32_t _Epoch;
+};
+
+// Storage formats of the depth buffer with their layout fixed at compile
+// time. Stored values are biased so that CLEARED is 0 in the integer formats.
+struct Depth16
+{
+    static const DepthBuffer::Format FORMAT = DepthBuffer::DEPTH16;
+    static const long MAX_DEPTH = 0xfffe;
+
+    static long Load(const unsigned char *data, std::size_t offset)
+    {
+        return (long)((const std::uint16_t *)data)[offset] - 1;
+    }
+    static void Store(unsigned char *data, std::size_t offset, long depth)
+    {
+        ((std::uint16_t *)data)[offset] = (std::uint16_t)(depth + 1);
+    }
+};
+
+struct Depth24
+{
+    static const DepthBuffer::Format FORMAT = DepthBuffer::DEPTH24;
+    static const long MAX_DEPTH = 0xfffffe;
+
+    static long Load(const unsigned char *data, std::size_t offset)
+    {
+        const unsigned char *p = data + offset * 3;
+        return (long)(p[0] | (p[1] << 8) | (p[2] << 16)) - 1;
+    }
+    static void Store(unsigned char *data, std::size_t offset, long depth)
+    {
+        unsigned long stored = depth + 1;
+        unsigned char *p = data + offset * 3;
+        p[0] = stored & 0xff;
+        p[1] = (stored >> 8) & 0xff;
+        p[2] = (stored >> 16) & 0xff;
+    }
+};
+
+struct Depth32F
+{
+    static const DepthBuffer::Format FORMAT = DepthBuffer::DEPTH32F;
+    static const long MAX_DEPTH = 1L << 24; // integers above 2^24 are not exact in a float
+
+    static long Load(const unsigned char *data, std::size_t offset)
+    {
+        return (long)((const float *)data)[offset];
+    }
+    static void Store(unsigned char *data, std::size_t offset, long depth)
+    {
+        ((float *)data)[offset] = (float)depth;
+    }
+};
+
+// Typed, non-owning view of a DepthBuffer whose format is 'DepthFormat'.
+// Get and Set behave as DepthBuffer's, but the format is a constant and
+// they inline to the block epoch test and a direct load or store.
+template <class DepthFormat>
+class Depth
+{
+    public:
+        explicit Depth(DepthBuffer &buffer)
+            : _Buffer(buffer), _Data(buffer._Data), _Width(buffer._Width), _BlocksX(buffer._BlocksX),
+              _BlockEpoch(buffer._BlockEpoch.data()), _Epoch(buffer._Epoch) {};
+
+        long GetWidth() const  { return _Width; }
+        long GetHeight() const { return _Buffer._Height; }
+
+        long Get(long x, long y) const
+        {
+            if (_BlockEpoch[GetBlock(x, y)] != _Epoch)
+            {
+                return DepthBuffer::CLEARED;
+            }
+            return DepthFormat::Load(_Data, x + y * _Width);
+        }
+        void Set(long x, long y, long depth) const
+        {
+            std::size_t block = GetBlock(x, y);
+            if (_BlockEpoch[block] != _Epoch)
+            {
+                _Buffer.ResetBlock(block);
+            }
+            DepthFormat::Store(_Data, x + y * _Width,
+                               depth < 0 ? 0 : (depth > DepthFormat::MAX_DEPTH ? DepthFormat::MAX_DEPTH : depth));
+        }
+
+    private:
+        std::size_t GetBlock(long x, long y) const
+        {
+            return (y / DepthBuffer::BLOCK_SIZE) * _BlocksX + x / DepthBuffer::BLOCK_SIZE;
+        }
+
+        DepthBuffer &_Buffer;
+        unsigned char *_Data;
+        long _Width;
+        long _BlocksX;
+        const std::uint32_t *_BlockEpoch;
+        std::uint32_t _Epoch;
+};
+
+inline long DepthBuffer::Load(std::size_t offset) const
+{
+    switch (_Format)
+    {
+        case DEPTH16:
+            return Depth16::Load(_Data, offset);
+        case DEPTH24:
+            return Depth24::Load(_Data, offset);
+        default:
+            return Depth32F::Load(_Data, offset);
+    }
+}
+
+inline void DepthBuffer::Store(std::size_t offset, long depth)
+{
+    switch (_Format)
+    {
+        case DEPTH16:
+            Depth16::Store(_Data, offset, depth);
+            break;
+        case DEPTH24:
+            Depth24::Store(_Data, offset, depth);
+            break;
+        default:
+            Depth32F::Store(_Data, offset, depth);
+            break;
+    }
+}
+
+inline long DepthBuffer::Get(long x, long y) const
+{
+    if (_BlockEpoch[GetBlock(x, y)] != _Epoch)
+    {
+        return CLEARED;
+    }
+    return Load(x + y * _Width);
+}
+
+inline void DepthBuffer::Set(long x, long y, long depth)
+{
+    std::size_t block = GetBlock(x, y);
+    if (_BlockEpoch[block] != _Epoch)
+    {
+        ResetBlock(block);
+    }
+    long max_depth = GetMaxDepth();
+    Store(x + y * _Width, depth < 0 ? 0 : (depth > max_depth ? max_depth : depth));
+}
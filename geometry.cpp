@@ -0,0 +1,125 @@
+#include "geometry.h"
+#include "simd.h"
+
+namespace
+{
+
+// One row of the upper 3x3 of M applied to a whole pack of vectors; also used
+// with plain floats for the tail that does not fill a pack.
+template <typename T>
+inline T apply_row(const T *row, T x, T y, T z)
+{
+    return row[0] * x + row[1] * y + row[2] * z;
+}
+
+template <typename T>
+inline void transform_point(const T (&m)[4][4], bool divide, T &x, T &y, T &z, T &w)
+{
+    T tx = apply_row(m[0], x, y, z) + m[0][3];
+    T ty = apply_row(m[1], x, y, z) + m[1][3];
+    T tz = apply_row(m[2], x, y, z) + m[2][3];
+    if (divide)
+    {
+        w = apply_row(m[3], x, y, z) + m[3][3];
+        tx = tx / w;
+        ty = ty / w;
+        tz = tz / w;
+    }
+    x = tx;
+    y = ty;
+    z = tz;
+}
+
+template <typename T>
+inline void transform_direction(const T (&m)[4][4], T &x, T &y, T &z)
+{
+    T tx = apply_row(m[0], x, y, z);
+    T ty = apply_row(m[1], x, y, z);
+    T tz = apply_row(m[2], x, y, z);
+    x = tx;
+    y = ty;
+    z = tz;
+}
+
+void broadcast(const Matrix4 &M, simd::FloatPack (&m)[4][4])
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            m[i][j] = simd::Set1(M.m[i][j]);
+        }
+    }
+}
+
+}
+
+void transform_points(const Matrix4 &M, const Vector3Array &in, Vector3Array &out, std::vector<float> *w)
+{
+    const std::size_t count = in.size();
+    out.resize(count);
+    const bool divide = !M.is_affine();
+    if (w)
+    {
+        w->assign(count, 1.f);
+    }
+    simd::FloatPack m[4][4];
+    broadcast(M, m);
+
+    std::size_t i = 0;
+    for (; i + simd::WIDTH <= count; i += simd::WIDTH)
+    {
+        simd::FloatPack x = simd::Load(&in.x[i]);
+        simd::FloatPack y = simd::Load(&in.y[i]);
+        simd::FloatPack z = simd::Load(&in.z[i]);
+        simd::FloatPack pw = simd::Set1(1.f);
+        transform_point(m, divide, x, y, z, pw);
+        simd::Store(&out.x[i], x);
+        simd::Store(&out.y[i], y);
+        simd::Store(&out.z[i], z);
+        if (w && divide)
+        {
+            simd::Store(&(*w)[i], pw);
+        }
+    }
+    for (; i < count; i++)
+    {
+        float x = in.x[i], y = in.y[i], z = in.z[i], pw = 1.f;
+        transform_point(M.m, divide, x, y, z, pw);
+        out.x[i] = x;
+        out.y[i] = y;
+        out.z[i] = z;
+        if (w)
+        {
+            (*w)[i] = pw;
+        }
+    }
+}
+
+void transform_directions(const Matrix4 &M, const Vector3Array &in, Vector3Array &out)
+{
+    const std::size_t count = in.size();
+    out.resize(count);
+    simd::FloatPack m[4][4];
+    broadcast(M, m);
+
+    std::size_t i = 0;
+    for (; i + simd::WIDTH <= count; i += simd::WIDTH)
+    {
+        simd::FloatPack x = simd::Load(&in.x[i]);
+        simd::FloatPack y = simd::Load(&in.y[i]);
+        simd::FloatPack z = simd::Load(&in.z[i]);
+        transform_direction(m, x, y, z);
+        simd::Store(&out.x[i], x);
+        simd::Store(&out.y[i], y);
+        simd::Store(&out.z[i], z);
+    }
+    for (; i < count; i++)
+    {
+        float x = in.x[i], y = in.y[i], z = in.z[i];
+        transform_direction(M.m, x, y, z);
+        out.x[i] = x;
+        out.y[i] = y;
+        out.z[i] = z;
+    }
+}
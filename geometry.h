@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cmath>
+#include <cstddef>
+#include <vector>
 
 template <typename T>
 class Vector2 {
@@ -57,3 +59,143 @@ public:
 typedef Vector3<float> Vector3f;
 typedef Vector3<long> Vector3l;
 
+
+// 4x4 matrix acting on column vectors, p' = M * p. Points are extended with
+// w = 1 and divided by the resulting w, directions use the upper 3x3 only.
+class Matrix4 {
+public:
+    Matrix4() {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                m[i][j] = (i == j) ? 1.f : 0.f;
+            }
+        }
+    }
+
+    Matrix4 operator*(const Matrix4 &M) const {
+        Matrix4 result;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                result.m[i][j] = m[i][0] * M.m[0][j] + m[i][1] * M.m[1][j] +
+                                 m[i][2] * M.m[2][j] + m[i][3] * M.m[3][j];
+            }
+        }
+        return result;
+    }
+
+    // True when the last row is (0, 0, 0, 1), so w stays 1.
+    bool is_affine() const {
+        return m[3][0] == 0 && m[3][1] == 0 && m[3][2] == 0 && m[3][3] == 1;
+    }
+
+    // Inverse transpose of the upper 3x3, which keeps normals perpendicular
+    // to the surface under non-uniform scales.
+    Matrix4 normal_matrix() const {
+        Matrix4 result;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+                int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+                result.m[i][j] = m[i1][j1] * m[i2][j2] - m[i1][j2] * m[i2][j1];
+            }
+        }
+        float det = m[0][0] * result.m[0][0] + m[0][1] * result.m[0][1] + m[0][2] * result.m[0][2];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                result.m[i][j] /= det;
+            }
+        }
+        return result;
+    }
+
+    static Matrix4 translation(const Vector3f &t) {
+        Matrix4 result;
+        result.m[0][3] = t.x;
+        result.m[1][3] = t.y;
+        result.m[2][3] = t.z;
+        return result;
+    }
+
+    static Matrix4 scaling(float s) {
+        Matrix4 result;
+        result.m[0][0] = result.m[1][1] = result.m[2][2] = s;
+        return result;
+    }
+
+    static Matrix4 rotation_y(float angle) {
+        Matrix4 result;
+        result.m[0][0] = result.m[2][2] = std::cos(angle);
+        result.m[0][2] = std::sin(angle);
+        result.m[2][0] = -result.m[0][2];
+        return result;
+    }
+
+    // Moves 'center' to the origin and turns the frame so that the camera at
+    // 'eye' looks down the -z axis with 'up' along +y.
+    static Matrix4 look_at(const Vector3f &eye, const Vector3f &center, const Vector3f &up) {
+        Vector3f z = eye - center;
+        z.normalize();
+        Vector3f x = up ^ z;
+        x.normalize();
+        Vector3f y = z ^ x;
+        Matrix4 rotation;
+        const Vector3f *axes[3] = {&x, &y, &z};
+        for (int i = 0; i < 3; i++) {
+            rotation.m[i][0] = axes[i]->x;
+            rotation.m[i][1] = axes[i]->y;
+            rotation.m[i][2] = axes[i]->z;
+        }
+        return rotation * translation(Vector3f() - center);
+    }
+
+    // Central projection for a camera on the +z axis at 'distance' from the
+    // origin: w = 1 - z / distance, so the plane z = 0 keeps its scale. Depth
+    // runs from -1 on the far plane to 1 on the near plane, both given as
+    // distances from the camera.
+    static Matrix4 perspective(float distance, float near, float far) {
+        float z_near = distance - near;
+        float z_far = distance - far;
+        Matrix4 result;
+        result.m[2][2] = (2.f - (z_near + z_far) / distance) / (z_near - z_far);
+        result.m[2][3] = 1.f - z_near / distance - result.m[2][2] * z_near;
+        result.m[3][2] = -1.f / distance;
+        return result;
+    }
+
+    // Maps [-1, 1]^3 to [x, x + width] x [y, y + height] x [0, depth].
+    static Matrix4 viewport(float x, float y, float width, float height, float depth) {
+        Matrix4 result;
+        result.m[0][0] = width / 2.f;
+        result.m[0][3] = x + width / 2.f;
+        result.m[1][1] = height / 2.f;
+        result.m[1][3] = y + height / 2.f;
+        result.m[2][2] = depth / 2.f;
+        result.m[2][3] = depth / 2.f;
+        return result;
+    }
+
+    float m[4][4];
+};
+
+// Structure-of-arrays batch of vectors, the layout the batched transforms
+// below run on.
+struct Vector3Array {
+    std::size_t size() const { return x.size(); }
+    void resize(std::size_t n) {
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+    }
+
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+};
+
+// Transforms every point of 'in' by M, including the division by w unless M
+// is affine. 'out' is resized to match and may be 'in' itself. The w of
+// every point is stored in 'w' when given; w <= 0 is at or behind the eye.
+void transform_points(const Matrix4 &M, const Vector3Array &in, Vector3Array &out, std::vector<float> *w = nullptr);
+
+// Transforms every direction of 'in' by the upper 3x3 of M.
+void transform_directions(const Matrix4 &M, const Vector3Array &in, Vector3Array &out);
@@ -0,0 +1,43 @@
+#include <algorithm>
+#include "hiz_buffer.h"
+
+HierarchicalZ::HierarchicalZ(long width, long height, long clear_depth)
+    : _Width(width), _Height(height), _CulledTriangles(0), _CulledBlocks(0)
+{
+    _BlocksX = (_Width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    _BlocksY = (_Height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    Clear(clear_depth);
+}
+
+void HierarchicalZ::Clear(long clear_depth)
+{
+    _Min.assign(_BlocksX * _BlocksY, clear_depth);
+    _Max.assign(_BlocksX * _BlocksY, clear_depth);
+}
+
+bool HierarchicalZ::IsRectOccluded(long x0, long y0, long x1, long y1, long z_max) const
+{
+    for (long by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++)
+    {
+        for (long bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++)
+        {
+            if (!IsOccluded(bx, by, z_max))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void HierarchicalZ::AddCulled(unsigned long triangles, unsigned long blocks)
+{
+    if (triangles)
+    {
+        _CulledTriangles.fetch_add(triangles, std::memory_order_relaxed);
+    }
+    if (blocks)
+    {
+        _CulledBlocks.fetch_add(blocks, std::memory_order_relaxed);
+    }
+}
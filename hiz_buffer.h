@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "depth_buffer.h"
+
+// Coarse depth bounds over BLOCK_SIZE x BLOCK_SIZE pixel blocks of a z-buffer.
+// A fragment passes the depth test when its depth is greater than the stored
+// one, so a block can be skipped when a triangle's nearest depth is not above
+// the block minimum, and the per-pixel test can be skipped when the triangle's
+// farthest depth is above the block maximum.
+class HierarchicalZ
+{
+    public:
+        static const long BLOCK_SIZE = 8;
+
+        HierarchicalZ(long width, long height, long clear_depth);
+
+        // Resets the bounds; the culling counters keep accumulating.
+        void Clear(long clear_depth);
+
+        long GetBlocksX() const { return _BlocksX; }
+        long GetBlocksY() const { return _BlocksY; }
+
+        bool IsOccluded(long bx, long by, long z_max) const { return z_max <= _Min[by * _BlocksX + bx]; }
+        bool IsVisible(long bx, long by, long z_min) const  { return z_min > _Max[by * _BlocksX + bx]; }
+
+        // True when no pixel of the blocks covering [x0, x1] x [y0, y1] can
+        // be overwritten by a depth of at most 'z_max'.
+        bool IsRectOccluded(long x0, long y0, long x1, long y1, long z_max) const;
+
+        // Re-reads the bounds of a block from the full resolution buffer.
+        // Must be called after writing to the block.
+        template <class DepthFormat>
+        void UpdateBlock(long bx, long by, const Depth<DepthFormat> &zbuffer);
+
+        // A triangle counts once however many tiles it was drawn in, so the
+        // totals are the same for the serial and the tiled renderers.
+        void AddCulled(unsigned long triangles, unsigned long blocks);
+        unsigned long GetCulledTriangles() const { return _CulledTriangles; }
+        unsigned long GetCulledBlocks() const    { return _CulledBlocks; }
+
+    private:
+        long _Width;
+        long _Height;
+        long _BlocksX;
+        long _BlocksY;
+        std::vector<long> _Min;
+        std::vector<long> _Max;
+
+        std::atomic<unsigned long> _CulledTriangles;
+        std::atomic<unsigned long> _CulledBlocks;
+};
+
+template <class DepthFormat>
+void HierarchicalZ::UpdateBlock(long bx, long by, const Depth<DepthFormat> &zbuffer)
+{
+    long x_end = std::min((bx + 1) * BLOCK_SIZE, _Width);
+    long y_end = std::min((by + 1) * BLOCK_SIZE, _Height);
+    long min = zbuffer.Get(bx * BLOCK_SIZE, by * BLOCK_SIZE);
+    long max = min;
+    for (long y = by * BLOCK_SIZE; y < y_end; y++)
+    {
+        for (long x = bx * BLOCK_SIZE; x < x_end; x++)
+        {
+            long depth = zbuffer.Get(x, y);
+            min = std::min(min, depth);
+            max = std::max(max, depth);
+        }
+    }
+    _Min[by * _BlocksX + bx] = min;
+    _Max[by * _BlocksX + bx] = max;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "tgaimage.h"
+
+// Pixel formats of the TGA images with their byte layout fixed at compile
+// time. Channels are stored in TGAColor::raw order (B, G, R, A). Every format
+// has its own Pixel type holding exactly its bytes. FromBgra converts from
+// channels packed as in TGAColor::val, keeping the first BYTES of them as
+// TGAImage::set does, and ToColor converts back to a TGAColor.
+struct Gray8
+{
+    static const int BYTES = TGAImage::GRAYSCALE;
+    typedef std::uint8_t Pixel;
+
+    static Pixel Load(const unsigned char *p) { return p[0]; }
+    static void Store(unsigned char *p, Pixel c) { p[0] = c; }
+
+    static Pixel FromBgra(std::uint32_t bgra) { return (Pixel)bgra; }
+    static TGAColor ToColor(Pixel c) { return TGAColor((int)c, BYTES); }
+};
+
+struct RGB8
+{
+    static const int BYTES = TGAImage::RGB;
+    struct Pixel
+    {
+        unsigned char b, g, r;
+    };
+
+    static Pixel Load(const unsigned char *p)
+    {
+        Pixel c = {p[0], p[1], p[2]};
+        return c;
+    }
+    static void Store(unsigned char *p, Pixel c)
+    {
+        p[0] = c.b;
+        p[1] = c.g;
+        p[2] = c.r;
+    }
+
+    static Pixel FromBgra(std::uint32_t bgra)
+    {
+        Pixel c = {(unsigned char)bgra, (unsigned char)(bgra >> 8), (unsigned char)(bgra >> 16)};
+        return c;
+    }
+    static TGAColor ToColor(Pixel c) { return TGAColor((int)(c.b | (c.g << 8) | (c.r << 16)), BYTES); }
+};
+
+struct RGBA8
+{
+    static const int BYTES = TGAImage::RGBA;
+    typedef std::uint32_t Pixel;
+
+    static Pixel Load(const unsigned char *p)
+    {
+        Pixel c;
+        std::memcpy(&c, p, BYTES);
+        return c;
+    }
+    static void Store(unsigned char *p, Pixel c) { std::memcpy(p, &c, BYTES); }
+
+    static Pixel FromBgra(std::uint32_t bgra) { return bgra; }
+    static TGAColor ToColor(Pixel c) { return TGAColor((int)c, BYTES); }
+};
+
+// Typed, non-owning view of the pixels of a TGAImage. Unlike TGAImage::get
+// and set, the pixel size is a constant and every accessor inlines to a
+// direct load or store of a Format::Pixel; the *Unchecked ones also skip
+// the bounds test and are meant for loops that clip their range up front.
+// Callers convert a TGAColor with FromColor once, outside their loops.
+template <class Format>
+class Image
+{
+    public:
+        typedef typename Format::Pixel Pixel;
+
+        explicit Image(const TGAView &view) : _Data(view.data), _Width(view.width), _Height(view.height),
+                                              _Stride(view.stride) {};
+
+        static Pixel FromColor(const TGAColor &c) { return Format::FromBgra(c.val); }
+
+        int GetWidth() const  { return _Width; }
+        int GetHeight() const { return _Height; }
+
+        Pixel GetUnchecked(long x, long y) const { return Format::Load(GetPixel(x, y)); }
+        void SetUnchecked(long x, long y, Pixel c) const { Format::Store(GetPixel(x, y), c); }
+
+        Pixel Get(long x, long y) const
+        {
+            return Contains(x, y) ? GetUnchecked(x, y) : Format::FromBgra(0);
+        }
+        bool Set(long x, long y, Pixel c) const
+        {
+            if (!Contains(x, y))
+            {
+                return false;
+            }
+            SetUnchecked(x, y, c);
+            return true;
+        }
+
+    private:
+        bool Contains(long x, long y) const
+        {
+            return (unsigned long)x < (unsigned long)_Width && (unsigned long)y < (unsigned long)_Height;
+        }
+        unsigned char *GetPixel(long x, long y) const { return _Data + y * _Stride + x * Format::BYTES; }
+
+        unsigned char *_Data;
+        int _Width;
+        int _Height;
+        long _Stride;
+};
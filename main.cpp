@@ -1,12 +1,30 @@
+#include <array>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <limits>
 #include <cmath>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "tgaimage.h"
 #include "obj_model.h"
+#include "profiler.h"
+#include "culler.h"
+#include "deferred_renderer.h"
+#include "depth_buffer.h"
+#include "obj_stream.h"
+#include "rasterizer.h"
+#include "scene.h"
+#include "thread_pool.h"
+#include "tile_renderer.h"
+#include "vertex_stage.h"
 
 const TGAColor white  = TGAColor(255, 255, 255, 255);
 const TGAColor red    = TGAColor(255, 0,   0,   255);
@@ -14,194 +32,561 @@ const TGAColor blue   = TGAColor(0,   0,   255, 255);
 const TGAColor green  = TGAColor(0,   255, 0,   255);
 const TGAColor purple = TGAColor(255, 0,   255, 255);
 
-void line(TGAImage &image, int x0, int y0, int x1, int y1, TGAColor color)
+struct Options
 {
-    bool xy_swap = false;
+    Options() : threads(1), tile_size(64), raster(RASTER_SCANLINE), hiz(false), deferred(false), depth(DepthBuffer::DEPTH16),
+                mesh_cache(true), vertex_cache(false), frames(1), profile_path("profile.json"),
+                wrap(Texture::WRAP_BORDER), mipmaps(false), preview(0), camera(false),
+                center(0, 0, 0), cull_back_faces(true), stream_megabytes(0) {};
 
-    if (std::abs(y1 - y0) > std::abs(x1 - x0))
+    // 1 keeps the serial scanline loop, 0 uses every core, anything else
+    // enables the tile-binned renderer with that many threads.
+    unsigned long threads;
+    long tile_size;
+    RasterMode raster;
+    bool hiz;
+    // Depth and triangle ids first, then one shading pass over the visible
+    // pixels; draws what the fixed-point rasterizer does.
+    bool deferred;
+    DepthBuffer::Format depth;
+    bool mesh_cache;
+    bool vertex_cache;
+    // Frames of a turntable: frame i is rotated by 2 * pi * i / frames
+    // around the vertical axis.
+    unsigned long frames;
+    // Where the stage timers and counters go in profiling builds.
+    std::string profile_path;
+    Texture::WrapMode wrap;
+    // Trilinear filtering with a per-triangle level of detail.
+    bool mipmaps;
+    // Width of a downscaled copy written next to every output, 0 for none.
+    long preview;
+    // Perspective camera at 'eye' looking at 'center'; without it the model
+    // is projected orthographically along -z.
+    bool camera;
+    Vector3f eye;
+    Vector3f center;
+    bool cull_back_faces;
+    // Scene file to draw instead of the model and texture given as
+    // positional arguments.
+    std::string scene_path;
+    // Reads the faces of the model in chunks while drawing instead of
+    // loading it whole, with about this many megabytes of faces in memory
+    // at a time; 0 loads the model.
+    unsigned long stream_megabytes;
+    std::vector<std::string> positional;
+};
+
+static
+bool parse_vector(const char *text, Vector3f &v)
+{
+    return std::sscanf(text, "%f,%f,%f", &v.x, &v.y, &v.z) == 3;
+}
+
+static
+bool parse_options(int argc, char **argv, Options &options)
+{
+    bool raster_given = false;
+    for (int i = 1; i < argc; i++)
     {
-        xy_swap = true;
-        std::swap(x0, y0);
-        std::swap(x1, y1);
+        std::string arg = argv[i];
+        if ((arg == "--threads" || arg == "-j") && i + 1 < argc)
+        {
+            options.threads = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--tile" && i + 1 < argc)
+        {
+            options.tile_size = std::strtol(argv[++i], nullptr, 10);
+            if (options.tile_size <= 0)
+            {
+                return false;
+            }
+        }
+        else if (arg == "--raster" && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            raster_given = true;
+            if (mode == "scanline")
+            {
+                options.raster = RASTER_SCANLINE;
+            }
+            else if (mode == "edge")
+            {
+                options.raster = RASTER_EDGE;
+            }
+            else if (mode == "fixed")
+            {
+                options.raster = RASTER_FIXED;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (arg == "--hiz")
+        {
+            options.hiz = true;
+        }
+        else if (arg == "--deferred")
+        {
+            options.deferred = true;
+        }
+        else if (arg == "--depth" && i + 1 < argc)
+        {
+            std::string format = argv[++i];
+            if (format == "16")
+            {
+                options.depth = DepthBuffer::DEPTH16;
+            }
+            else if (format == "24")
+            {
+                options.depth = DepthBuffer::DEPTH24;
+            }
+            else if (format == "32f")
+            {
+                options.depth = DepthBuffer::DEPTH32F;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (arg == "--no-mesh-cache")
+        {
+            options.mesh_cache = false;
+        }
+        else if (arg == "--vcache")
+        {
+            options.vertex_cache = true;
+        }
+        else if (arg == "--frames" && i + 1 < argc)
+        {
+            options.frames = std::strtoul(argv[++i], nullptr, 10);
+            if (options.frames == 0)
+            {
+                return false;
+            }
+        }
+        else if (arg == "--profile" && i + 1 < argc)
+        {
+            options.profile_path = argv[++i];
+        }
+        else if (arg == "--wrap" && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            if (mode == "border")
+            {
+                options.wrap = Texture::WRAP_BORDER;
+            }
+            else if (mode == "clamp")
+            {
+                options.wrap = Texture::WRAP_CLAMP;
+            }
+            else if (mode == "repeat")
+            {
+                options.wrap = Texture::WRAP_REPEAT;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (arg == "--preview" && i + 1 < argc)
+        {
+            options.preview = std::strtol(argv[++i], nullptr, 10);
+            if (options.preview <= 0)
+            {
+                return false;
+            }
+        }
+        else if (arg == "--camera" && i + 1 < argc)
+        {
+            options.camera = true;
+            if (!parse_vector(argv[++i], options.eye))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--look-at" && i + 1 < argc)
+        {
+            if (!parse_vector(argv[++i], options.center))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--cull" && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            if (mode == "back")
+            {
+                options.cull_back_faces = true;
+            }
+            else if (mode == "none")
+            {
+                options.cull_back_faces = false;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (arg == "--scene" && i + 1 < argc)
+        {
+            options.scene_path = argv[++i];
+        }
+        else if (arg == "--stream" && i + 1 < argc)
+        {
+            options.stream_megabytes = std::strtoul(argv[++i], nullptr, 10);
+            if (options.stream_megabytes == 0)
+            {
+                return false;
+            }
+        }
+        else if (arg == "--mipmaps")
+        {
+            options.mipmaps = true;
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            return false;
+        }
+        else
+        {
+            options.positional.push_back(arg);
+        }
     }
-    if (x0 > x1)
+    if (options.camera && (options.eye - options.center).len() == 0)
     {
-        std::swap(x0, x1);
-        std::swap(y0, y1);
+        return false;
     }
-
-    int x_delta = x1 - x0;
-    int y_delta = 2 * std::abs(y1 - y0);
-    int y_error = 0;
-    int y_curr = y0;
-    for (int x_curr = x0; x_curr < x1; x_curr++)
+    if (options.deferred)
     {
-        if (xy_swap)
+        // the depth pass draws what the fixed-point rasterizer does and keeps
+        // no hierarchical z
+        if ((raster_given && options.raster != RASTER_FIXED) || options.hiz)
         {
-            image.set(y_curr, x_curr, color);
+            return false;
         }
-        else
+        options.raster = RASTER_FIXED;
+    }
+    if (options.hiz)
+    {
+        // hierarchical z is maintained by the edge rasterizer only
+        if (raster_given && options.raster != RASTER_EDGE)
+        {
+            return false;
+        }
+        options.raster = RASTER_EDGE;
+    }
+    if (options.stream_megabytes > 0)
+    {
+        // a streamed model is never whole in memory, so it can not be
+        // reordered or shaded after all of it is drawn
+        if (!options.scene_path.empty() || options.vertex_cache || options.deferred)
         {
-            image.set(x_curr, y_curr, color);
+            return false;
         }
+    }
+    if (!options.scene_path.empty())
+    {
+        return options.positional.empty();
+    }
+    return options.positional.empty() || options.positional.size() == 2;
+}
 
-        y_error += y_delta;
-        if (y_error > x_delta)
+#ifdef ENABLE_PROFILING
+static
+void count_covered_pixels(const DepthBuffer &zbuffer)
+{
+    unsigned long covered = 0;
+    for (long y = 0; y < zbuffer.GetHeight(); y++)
+    {
+        for (long x = 0; x < zbuffer.GetWidth(); x++)
         {
-            y_curr += (y1 > y0) ? 1 : -1;
-            y_error -= 2 * x_delta;
+            covered += (zbuffer.Get(x, y) != DepthBuffer::CLEARED);
         }
     }
+    PROFILE_COUNT(PIXELS_COVERED, covered);
 }
+#endif
 
-void triangle(TGAImage &image, std::array<Vector3l, 3> &v, std::array<Vector3f, 3> &n,
-              std::array<Vector2l, 3> &u, std::vector<long> &zbuffer, ObjModel &model, Vector3f &light)
+int main(int argc, char** argv)
 {
-    if (v[0].y > v[1].y)
+    Options options;
+    if (!parse_options(argc, argv, options))
     {
-        std::swap(v[0], v[1]);
-        std::swap(n[0], n[1]);
-        std::swap(u[0], u[1]);
+        std::cerr << "Usage: " << argv[0] << " [--threads N] [--tile SIZE] [--raster scanline|edge|fixed] [--hiz] [--deferred] [--depth 16|24|32f] [--no-mesh-cache] [--vcache] [--frames N] [--profile FILE] [--wrap border|clamp|repeat] [--mipmaps] [--preview WIDTH] [--camera X,Y,Z] [--look-at X,Y,Z] [--cull back|none] [--stream MB] [--scene FILE | model.obj texture.tga]" << std::endl;
+        return 1;
     }
-    if (v[0].y > v[2].y)
+
+    PROFILE_INIT(options.profile_path.c_str());
+
+    TGAImage image(800, 800, TGAImage::RGB);
+
+    bool tiled = options.threads != 1;
+    // the tiled and the deferred renderers take the triangles of a streamed
+    // chunk, or of the instances in batches of a bounded size, at once
+    bool batched = tiled || options.deferred;
+
+    Scene scene(options.mesh_cache, options.mipmaps);
+    std::unique_ptr<ObjStream> stream;
+    try
     {
-        std::swap(v[0], v[2]);
-        std::swap(n[0], n[2]);
-        std::swap(u[0], u[2]);
+        if (!options.scene_path.empty())
+        {
+            scene.Load(options.scene_path.c_str());
+        }
+        else
+        {
+            bool given = options.positional.size() == 2;
+            std::string mesh_path = given ? options.positional[0] : "./african_head.obj";
+            std::string texture_path = given ? options.positional[1] : "./african_head_diffuse.tga";
+            if (options.stream_megabytes > 0)
+            {
+                // a corner in flight costs its three indices in every chunk
+                // of the stream and, when binned, a third of a triangle
+                std::size_t corner_bytes = ObjStream::CHUNKS_IN_FLIGHT * 3 * sizeof(std::uint32_t);
+                if (batched)
+                {
+                    corner_bytes += (sizeof(ScreenTriangle) + sizeof(const Texture *) + 2) / 3;
+                }
+                stream.reset(new ObjStream(mesh_path.c_str(), (options.stream_megabytes << 20) / corner_bytes));
+                scene.AddTexture(texture_path);
+            }
+            else
+            {
+                scene.AddInstance(scene.AddMesh(mesh_path), scene.AddTexture(texture_path), Matrix4());
+            }
+        }
     }
-    if (v[1].y > v[2].y)
+    catch (const std::runtime_error &error)
     {
-        std::swap(v[1], v[2]);
-        std::swap(n[1], n[2]);
-        std::swap(u[1], u[2]);
+        std::cerr << std::endl << "Error: " << error.what() << std::endl;
+        return 1;
+    }
+    if (!stream && scene.GetInstancesCount() == 0)
+    {
+        std::cerr << "Error: the scene has no instances." << std::endl;
+        return 1;
     }
 
-    if (v[0].y == v[2].y)
+    for (std::size_t i = 0; i < scene.GetTexturesCount(); i++)
     {
-        return;
+        scene.GetTexture(i).SetWrapMode(options.wrap);
     }
 
-    float total_hight = v[2].y - v[0].y;
-    float low_sector_hight = v[1].y - v[0].y;
-    float high_sector_hight = v[2].y - v[1].y;
+    Vector3f light = {0, 0, 1};
+    DepthBuffer zbuffer(image.get_width(), image.get_height(), options.depth);
+
+    std::unique_ptr<HierarchicalZ> hiz;
+    if (options.hiz)
+    {
+        hiz.reset(new HierarchicalZ(image.get_width(), image.get_height(), DepthBuffer::CLEARED));
+    }
 
-    for (long y = v[0].y; y <= v[2].y; y++)
+    Rect screen(0, 0, image.get_width(), image.get_height());
+    const long depth = 255;
+    TriangleCuller culler(screen, depth, options.cull_back_faces);
+    std::vector<ScreenTriangle> triangles;
+    std::vector<const Texture *> textures;
+    std::vector<ScreenTriangle> clipped;
+    std::unique_ptr<ThreadPool> pool;
+    std::unique_ptr<TileRenderer> renderer;
+    std::unique_ptr<DeferredRenderer> deferred;
+    if (batched)
+    {
+        pool.reset(new ThreadPool(options.threads));
+    }
+    if (options.deferred)
     {
-        Vector2l left_u = u[0] + (u[2] - u[0]) * ((y - v[0].y) / total_hight);
-        Vector3l left_v = v[0] + (v[2] - v[0]) * ((y - v[0].y) / total_hight);
-        Vector3f left_n = n[0] + (n[2] - n[0]) * ((y - v[0].y) / total_hight);
-        Vector2l right_u;
-        Vector3l right_v;
-        Vector3f right_n;
+        deferred.reset(new DeferredRenderer(*pool, image.get_width(), image.get_height(), options.tile_size));
+    }
+    else if (tiled)
+    {
+        renderer.reset(new TileRenderer(*pool, image.get_width(), image.get_height(), options.tile_size));
+    }
 
-        if (y <= v[1].y)
+    // one vertex stage per mesh, shared by all the instances drawing it
+    std::vector<std::unique_ptr<VertexStage> > stages;
+    for (std::size_t i = 0; i < scene.GetMeshesCount(); i++)
+    {
+        stages.emplace_back(new VertexStage(scene.GetMesh(i)));
+        if (options.vertex_cache)
         {
-            float ratio = (low_sector_hight == 0) ? 1 : (y - v[0].y) / low_sector_hight;
-            right_v = v[0] + (v[1] - v[0]) * ratio;
-            right_u = u[0] + (u[1] - u[0]) * ratio;
-            right_n = n[0] + (n[1] - n[0]) * ratio;
+            float acmr_before = 0, acmr_after = 0;
+            stages.back()->OptimizeVertexCache(32, &acmr_before, &acmr_after);
+            std::cerr << "vertex cache: ACMR " << acmr_before << " -> " << acmr_after << std::endl;
+        }
+    }
+    std::unique_ptr<StreamVertexStage> stream_vertices;
+    if (stream)
+    {
+        stream_vertices.reset(new StreamVertexStage(*stream));
+    }
+
+    Matrix4 view_projection;
+    if (options.camera)
+    {
+        // depth is spent on the sphere holding the scene in every turntable
+        // frame only
+        float radius = stream ? stream->GetRadius() : scene.GetRadius();
+        float distance = (options.eye - options.center).len();
+        float near = std::max(distance - radius, distance / 10);
+        view_projection = Matrix4::perspective(distance, near, distance + radius) *
+                          Matrix4::look_at(options.eye, options.center, Vector3f(0, 1, 0));
+    }
+    Matrix4 viewport = Matrix4::viewport(0, 0, image.get_width(), image.get_height(), depth);
+
+    // Draws the queued triangles. Both batched renderers keep the depth
+    // buffers between calls, so a frame may be drawn in any number of
+    // batches; the callers account the time to STAGE_RASTER.
+    auto render_queued = [&]()
+    {
+        if (deferred)
+        {
+            deferred->Render(image, zbuffer, light, triangles, textures);
         }
         else
         {
-            float ratio = (high_sector_hight == 0) ? 1 : (y - v[1].y) / high_sector_hight;
-            right_v = v[1] + (v[2] - v[1]) * ratio;
-            right_u = u[1] + (u[2] - u[1]) * ratio;
-            right_n = n[1] + (n[2] - n[1]) * ratio;
+            renderer->Render(image, zbuffer, light, triangles, textures, options.raster, hiz.get());
         }
+        triangles.clear();
+        textures.clear();
+    };
+    // Triangles the batched renderers queue at most, about 14 MB of them, so
+    // that the queue does not grow with the number of instances.
+    const std::size_t max_queued = 1 << 16;
 
-        if (left_v.x > right_v.x)
+    // Culls and clips 't', then draws it or, for the batched renderers,
+    // queues it for flush().
+    auto submit = [&](const ScreenTriangle &t, const Texture &texture)
+    {
+        if (batched)
+        {
+            culler.Process(t, options.raster, triangles);
+            textures.resize(triangles.size(), &texture);
+            if (triangles.size() >= max_queued)
+            {
+                render_queued();
+            }
+            return;
+        }
+        clipped.clear();
+        culler.Process(t, options.raster, clipped);
+        for (const ScreenTriangle &c : clipped)
         {
-            std::swap(left_v, right_v);
-            std::swap(left_u, right_u);
-            std::swap(left_n, right_n);
+            if (rasterize(options.raster, image, c, zbuffer, texture, light, screen, hiz.get()))
+            {
+                hiz->AddCulled(1, 0);
+                PROFILE_COUNT(TRIANGLES_CULLED, 1);
+            }
         }
-        for (long x = left_v.x; x <= right_v.x; x++)
+    };
+    auto flush = [&]()
+    {
+        if (!batched)
         {
-            float ratio = (right_v.x == left_v.x) ? 1 : ((float)(x - left_v.x) / (right_v.x - left_v.x));
-            long z = left_v.z + (right_v.z - left_v.z) * ratio;
+            return;
+        }
+        PROFILE_SCOPE(STAGE_RASTER);
+        render_queued();
+    };
 
-            unsigned long width = image.get_width();
-            unsigned long offset = x + width * y;
-            if (zbuffer[offset] < z)
+    // Every frame reuses the image, the depth buffers, the vertex stages and
+    // the triangle list; only the scene rotation changes.
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned long frame = 0; frame < options.frames; frame++)
+    {
+        if (frame > 0)
+        {
+            image.clear();
+            zbuffer.Clear();
+            if (hiz)
             {
-                Vector3f curr_n = left_n + (right_n - left_n) * ratio;
-                curr_n.normalize();
-                float intensity = curr_n * light;
-                if (intensity > 0)
-                {
-                    Vector2l curr_u = left_u + (right_u - left_u) * ratio;
-                    TGAColor color = model.GetColor(curr_u.x, curr_u.y);
-                    color = TGAColor(color.r * intensity, color.g * intensity, color.b * intensity, color.a);
+                hiz->Clear(DepthBuffer::CLEARED);
+            }
+        }
 
-                    zbuffer[offset] = z;
-                    image.set(x, y, color);
+        Matrix4 turntable = Matrix4::rotation_y(2 * M_PI * frame / options.frames);
+        Matrix4 to_screen = viewport * view_projection * turntable;
+        if (stream)
+        {
+            // each chunk is drawn while the stream parses the next ones
+            const Texture &texture = scene.GetTexture(0);
+            stream_vertices->Transform(to_screen, turntable, texture);
+            stream->Rewind();
+            while (const ObjChunk *chunk = stream->Next())
+            {
+                {
+                    PROFILE_SCOPE(STAGE_RASTER);
+                    std::size_t chunk_triangles = chunk->face_v.size() / 3;
+                    PROFILE_COUNT(TRIANGLES_SUBMITTED, chunk_triangles);
+                    for (std::size_t i = 0; i < chunk_triangles; i++)
+                    {
+                        ScreenTriangle t;
+                        if (!stream_vertices->AssembleTriangle(*chunk, i, t))
+                        {
+                            PROFILE_COUNT(TRIANGLES_CULLED, 1);
+                            continue;
+                        }
+                        submit(t, texture);
+                    }
                 }
+                flush();
             }
         }
-    }
-}
+        for (const Scene::Batch &batch : scene.GetBatches())
+        {
+            VertexStage &vertices = *stages[batch.mesh];
+            const Texture &texture = scene.GetTexture(batch.texture);
+            for (const Matrix4 &instance : batch.instances)
+            {
+                vertices.Transform(to_screen * instance, turntable * instance, texture);
 
-int main(int argc, char** argv)
-{
-    TGAImage image(800, 800, TGAImage::RGB);
+                PROFILE_SCOPE(STAGE_RASTER);
+                PROFILE_COUNT(TRIANGLES_SUBMITTED, vertices.GetTrianglesCount());
+                for (std::size_t i = 0; i < vertices.GetTrianglesCount(); i++)
+                {
+                    ScreenTriangle t;
+                    if (!vertices.AssembleTriangle(i, t))
+                    {
+                        PROFILE_COUNT(TRIANGLES_CULLED, 1);
+                        continue;
+                    }
+                    submit(t, texture);
+                }
+            }
+        }
+        flush();
+        PROFILE_ONLY(count_covered_pixels(zbuffer);)
 
-    std::shared_ptr<ObjModel> model;
-    if (argc == 3)
-    {
-        model = std::make_shared<ObjModel>(argv[1]);
-        if (!model->LoadDiffuseTexture(argv[2]))
+        image.flip_vertically(); // i want to have the origin at the left bottom corner of the image
+        char suffix[24] = ""; // "_" and the digits of any unsigned long
+        if (options.frames > 1)
         {
-            std::cerr << std::endl << "Error: Can't load " << argv[2] << ".";
-            return 0;
+            std::snprintf(suffix, sizeof(suffix), "_%04lu", frame);
         }
-    }
-    else
-    {
-        model = std::make_shared<ObjModel>("./african_head.obj");
-        if (!model->LoadDiffuseTexture("./african_head_diffuse.tga"))
+        image.write_tga_file(("output" + std::string(suffix) + ".tga").c_str(), true, pool.get());
+        if (options.preview > 0)
         {
-            std::cerr << std::endl << "Error: Can't load african_head_diffuse.tga.";
-            return 0;
+            TGAImage preview(image);
+            int preview_height = std::max(1L, options.preview * image.get_height() / image.get_width());
+            preview.scale(options.preview, preview_height, TGAImage::BILINEAR, pool.get());
+            preview.write_tga_file(("preview" + std::string(suffix) + ".tga").c_str(), true, pool.get());
         }
     }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    Vector3f light = {0, 0, 1};
-    std::vector<long> zbuffer;
-    for (int i = 0; i < image.get_width() * image.get_height(); i++)
+    if (options.frames > 1)
     {
-        zbuffer.push_back(std::numeric_limits<int>::min());
+        std::cerr << options.frames << " frames in " << seconds << " s, "
+                  << options.frames / seconds << " frames/s" << std::endl;
     }
-
-    for (std::size_t i = 0; i < model->GetFacesCount(); i++)
+    if (hiz)
     {
-        std::vector<unsigned long> face_vertices = model->GetFaceVertices(i);
-        std::vector<unsigned long> face_textures = model->GetFaceTextures(i);
-        std::vector<unsigned long> face_normals = model->GetFaceNormals(i);
-        assert(face_vertices.size() == 3);
-        assert(face_vertices.size() == 3);
-        assert(face_normals.size() == 3);
-
-        std::array<Vector3f, 3> world_coords;
-        std::array<Vector3f, 3> normal_coords;
-        std::array<Vector3l, 3> screen_coords;
-        std::array<Vector2l, 3> texture_coords;
-
-        for (long i = 0; i < 3; i++)
-        {
-            const unsigned long depth = 255;
-            texture_coords[i] = model->GetVertexTexture(face_textures[i]);
-            normal_coords[i] = model->GetVertexNormal(face_normals[i]);
-            world_coords[i] = model->GetVertexGeometric(face_vertices[i]);
-            screen_coords[i] = Vector3l(std::round((world_coords[i].x + 1.) * image.get_width() / 2.),
-                                        std::round((world_coords[i].y + 1.) * image.get_height() / 2.),
-                                        std::round((world_coords[i].z + 1.) * depth / 2.));
-        }
-        triangle(image, screen_coords, normal_coords, texture_coords,
-                    zbuffer, *model, light);
+        std::cerr << "hiz: culled " << hiz->GetCulledTriangles() << " triangles, "
+                  << hiz->GetCulledBlocks() << " blocks" << std::endl;
     }
-    image.flip_vertically(); // i want to have the origin at the left bottom corner of the image
-    image.write_tga_file("output.tga");
 
     return 0;
 }
-
@@ -0,0 +1,80 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mapped_file.h"
+
+MappedFile::MappedFile() : _Fd(-1), _Data(nullptr), _Size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const char *p_filePath)
+{
+    Close();
+
+    _Fd = ::open(p_filePath, O_RDONLY);
+    if (_Fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (::fstat(_Fd, &info) != 0)
+    {
+        int saved_errno = errno;
+        Close();
+        errno = saved_errno;
+        return false;
+    }
+
+    _Size = info.st_size;
+    if (_Size == 0)
+    {
+        // mmap rejects empty mappings; an empty file is simply empty.
+        return true;
+    }
+
+    void *data = ::mmap(nullptr, _Size, PROT_READ, MAP_PRIVATE, _Fd, 0);
+    if (data == MAP_FAILED)
+    {
+        int saved_errno = errno;
+        Close();
+        errno = saved_errno;
+        return false;
+    }
+    ::madvise(data, _Size, MADV_SEQUENTIAL);
+    _Data = static_cast<const char *>(data);
+    return true;
+}
+
+void MappedFile::Discard(const char *begin, const char *end)
+{
+    const std::size_t page_size = ::sysconf(_SC_PAGESIZE);
+    std::size_t first = (begin - _Data + page_size - 1) / page_size * page_size;
+    std::size_t last = (end - _Data) / page_size * page_size;
+    if (_Data && first < last)
+    {
+        ::madvise(const_cast<char *>(_Data) + first, last - first, MADV_DONTNEED);
+    }
+}
+
+void MappedFile::Close()
+{
+    if (_Data)
+    {
+        ::munmap(const_cast<char *>(_Data), _Size);
+    }
+    if (_Fd >= 0)
+    {
+        ::close(_Fd);
+    }
+    _Fd = -1;
+    _Data = nullptr;
+    _Size = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        // Returns false and leaves errno set when the file can not be mapped.
+        bool Open(const char *p_filePath);
+        void Close();
+
+        // Drops the pages lying wholly inside [begin, end) from memory;
+        // reading them again faults them back in from the file.
+        void Discard(const char *begin, const char *end);
+
+        bool IsOpen() const           { return _Fd >= 0; }
+        const char *GetData() const   { return _Data; }
+        std::size_t GetSize() const   { return _Size; }
+
+    private:
+        int _Fd;
+        const char *_Data;
+        std::size_t _Size;
+};
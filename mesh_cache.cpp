@@ -0,0 +1,271 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mesh_cache.h"
+#include "obj_model.h"
+
+namespace
+{
+
+const char MESH_CACHE_MAGIC[8] = {'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E'};
+const std::uint32_t MESH_CACHE_BYTE_ORDER = 0x01020304;
+const std::uint64_t MESH_CACHE_ALIGNMENT = 64;
+
+enum MeshCacheArray
+{
+    ARRAY_VERTICES, ARRAY_TEXTURES, ARRAY_NORMALS,
+    ARRAY_FACE_V, ARRAY_FACE_VT, ARRAY_FACE_VN,
+    ARRAYS_COUNT
+};
+
+struct MeshCacheHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t source_size;
+    std::uint64_t source_mtime;
+    std::uint64_t source_checksum;
+    std::uint64_t offsets[ARRAYS_COUNT];
+    std::uint64_t counts[ARRAYS_COUNT];
+};
+
+static_assert(sizeof(Vector3f) == 3 * sizeof(float), "Vector3f must be tightly packed");
+static_assert(sizeof(Vector2f) == 2 * sizeof(float), "Vector2f must be tightly packed");
+
+const std::size_t ELEMENT_SIZES[ARRAYS_COUNT] = {
+    sizeof(Vector3f), sizeof(Vector2f), sizeof(Vector3f),
+    sizeof(std::uint32_t), sizeof(std::uint32_t), sizeof(std::uint32_t)
+};
+
+bool stat_source(const char *p_sourcePath, std::uint64_t &size, std::uint64_t &mtime)
+{
+    struct stat info;
+    if (::stat(p_sourcePath, &info) != 0)
+    {
+        return false;
+    }
+    size = info.st_size;
+    mtime = (std::uint64_t)info.st_mtim.tv_sec * 1000000000ULL + info.st_mtim.tv_nsec;
+    return true;
+}
+
+// Rewrites the source time in the header of the cache at 'p_cachePath'. A
+// failure is ignored: the cache stays valid, only slower to check.
+void update_source_time(const char *p_cachePath, std::uint64_t source_mtime)
+{
+    std::fstream out(p_cachePath, std::ios::in | std::ios::out | std::ios::binary);
+    if (out.is_open())
+    {
+        out.seekp(offsetof(MeshCacheHeader, source_mtime));
+        out.write((const char *)&source_mtime, sizeof(source_mtime));
+    }
+}
+
+// Whether corner 'i' of the face starting at corner 'face' holds an index
+// below 'count', or ObjModel::NO_INDEX like the whole face.
+bool check_optional_index(const ArrayView<std::uint32_t> &indices, std::size_t face, std::size_t i,
+                          std::size_t count)
+{
+    if (indices[face] == ObjModel::NO_INDEX)
+    {
+        return indices[i] == ObjModel::NO_INDEX;
+    }
+    return indices[i] < count;
+}
+
+template <typename T>
+ArrayView<T> make_view(const MappedFile &cache, const MeshCacheHeader &header, MeshCacheArray array)
+{
+    return ArrayView<T>(reinterpret_cast<const T *>(cache.GetData() + header.offsets[array]),
+                        header.counts[array]);
+}
+
+}
+
+bool check_face_indices(const MeshArrays &arrays)
+{
+    if (arrays.face_v.size() % 3 != 0
+        || arrays.face_vt.size() != arrays.face_v.size()
+        || arrays.face_vn.size() != arrays.face_v.size())
+    {
+        return false;
+    }
+    for (std::size_t face = 0; face < arrays.face_v.size(); face += 3)
+    {
+        for (std::size_t i = face; i < face + 3; i++)
+        {
+            if (arrays.face_v[i] >= arrays.vertices.size()
+                || !check_optional_index(arrays.face_vt, face, i, arrays.textures.size())
+                || !check_optional_index(arrays.face_vn, face, i, arrays.normals.size()))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::string MeshCache::GetCachePath(const char *p_sourcePath)
+{
+    return std::string(p_sourcePath) + ".cache";
+}
+
+std::uint64_t MeshCache::Checksum(const char *data, std::size_t size)
+{
+    // FNV-1a over 64-bit words, then over the tail bytes.
+    const std::uint64_t prime = 0x100000001b3ULL;
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    std::size_t i = 0;
+    for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t))
+    {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++)
+    {
+        hash = (hash ^ (unsigned char)data[i]) * prime;
+    }
+    return hash ^ size;
+}
+
+bool MeshCache::Load(const char *p_sourcePath, MappedFile &cache, MeshArrays &arrays)
+{
+    std::uint64_t source_size = 0;
+    std::uint64_t source_mtime = 0;
+    if (!stat_source(p_sourcePath, source_size, source_mtime))
+    {
+        return false;
+    }
+
+    std::string cache_path = GetCachePath(p_sourcePath);
+    if (!cache.Open(cache_path.c_str()))
+    {
+        return false;
+    }
+
+    MeshCacheHeader header;
+    if (cache.GetSize() < sizeof(header))
+    {
+        cache.Close();
+        return false;
+    }
+    std::memcpy(&header, cache.GetData(), sizeof(header));
+    if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != VERSION
+        || header.byte_order != MESH_CACHE_BYTE_ORDER
+        || header.source_size != source_size)
+    {
+        cache.Close();
+        return false;
+    }
+    for (int i = 0; i < ARRAYS_COUNT; i++)
+    {
+        if (header.offsets[i] % MESH_CACHE_ALIGNMENT != 0
+            || header.offsets[i] > cache.GetSize()
+            || header.counts[i] > (cache.GetSize() - header.offsets[i]) / ELEMENT_SIZES[i])
+        {
+            cache.Close();
+            return false;
+        }
+    }
+
+    // A touched but unchanged source only costs a checksum pass, once: the
+    // new time is written back so that later loads take the fast path.
+    if (header.source_mtime != source_mtime)
+    {
+        MappedFile source;
+        if (!source.Open(p_sourcePath)
+            || Checksum(source.GetData(), source.GetSize()) != header.source_checksum)
+        {
+            cache.Close();
+            return false;
+        }
+        update_source_time(cache_path.c_str(), source_mtime);
+    }
+
+    arrays.vertices = make_view<Vector3f>(cache, header, ARRAY_VERTICES);
+    arrays.textures = make_view<Vector2f>(cache, header, ARRAY_TEXTURES);
+    arrays.normals = make_view<Vector3f>(cache, header, ARRAY_NORMALS);
+    arrays.face_v = make_view<std::uint32_t>(cache, header, ARRAY_FACE_V);
+    arrays.face_vt = make_view<std::uint32_t>(cache, header, ARRAY_FACE_VT);
+    arrays.face_vn = make_view<std::uint32_t>(cache, header, ARRAY_FACE_VN);
+    // the checksum covers the source only, a corrupt payload must not reach
+    // the vertex stage
+    if (!check_face_indices(arrays))
+    {
+        arrays = MeshArrays();
+        cache.Close();
+        return false;
+    }
+    return true;
+}
+
+bool MeshCache::Save(const char *p_sourcePath, const char *source, std::size_t source_size,
+                     const MeshArrays &arrays)
+{
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.byte_order = MESH_CACHE_BYTE_ORDER;
+    header.source_size = source_size;
+    header.source_checksum = Checksum(source, source_size);
+    std::uint64_t source_stat_size = 0;
+    if (!stat_source(p_sourcePath, source_stat_size, header.source_mtime) || source_stat_size != source_size)
+    {
+        return false;
+    }
+
+    const void *data[ARRAYS_COUNT] = {
+        arrays.vertices.data(), arrays.textures.data(), arrays.normals.data(),
+        arrays.face_v.data(), arrays.face_vt.data(), arrays.face_vn.data()
+    };
+    header.counts[ARRAY_VERTICES] = arrays.vertices.size();
+    header.counts[ARRAY_TEXTURES] = arrays.textures.size();
+    header.counts[ARRAY_NORMALS] = arrays.normals.size();
+    header.counts[ARRAY_FACE_V] = arrays.face_v.size();
+    header.counts[ARRAY_FACE_VT] = arrays.face_vt.size();
+    header.counts[ARRAY_FACE_VN] = arrays.face_vn.size();
+
+    std::uint64_t offset = sizeof(header);
+    for (int i = 0; i < ARRAYS_COUNT; i++)
+    {
+        offset = (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+        header.offsets[i] = offset;
+        offset += header.counts[i] * ELEMENT_SIZES[i];
+    }
+
+    // Write to a temporary name and rename, so a concurrent reader never
+    // maps a half-written cache. The name is per process, so concurrent
+    // writers of the same cache do not write into each other's file.
+    std::string cache_path = GetCachePath(p_sourcePath);
+    std::string temp_path = cache_path + "." + std::to_string(::getpid()) + ".tmp";
+    std::ofstream out(temp_path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        return false;
+    }
+    const char padding[MESH_CACHE_ALIGNMENT] = {0};
+    out.write((const char *)&header, sizeof(header));
+    std::uint64_t written = sizeof(header);
+    for (int i = 0; i < ARRAYS_COUNT; i++)
+    {
+        out.write(padding, header.offsets[i] - written);
+        out.write((const char *)data[i], header.counts[i] * ELEMENT_SIZES[i]);
+        written = header.offsets[i] + header.counts[i] * ELEMENT_SIZES[i];
+    }
+    out.close();
+    if (!out.good() || std::rename(temp_path.c_str(), cache_path.c_str()) != 0)
+    {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "array_view.h"
+#include "geometry.h"
+#include "mapped_file.h"
+
+// Views over the arrays that make up a mesh, as stored by ObjModel.
+struct MeshArrays
+{
+    ArrayView<Vector3f> vertices;
+    ArrayView<Vector2f> textures;
+    ArrayView<Vector3f> normals;
+
+    ArrayView<std::uint32_t> face_v;
+    ArrayView<std::uint32_t> face_vt;
+    ArrayView<std::uint32_t> face_vn;
+};
+
+// Returns false unless the faces of 'arrays' come in triples of corners that
+// each index an existing vertex and, when given, an existing texture
+// coordinate and normal; a face gives those for all its corners or for none.
+bool check_face_indices(const MeshArrays &arrays);
+
+// Binary image of a parsed OBJ file, stored next to it as '<file>.cache'.
+// The file is a fixed header followed by the raw arrays, each aligned to
+// 64 bytes, so loading it is a single mmap and one pass checking the face
+// indices. The header records the size, modification time and checksum of
+// the OBJ it was built from; a cache whose source changed is ignored, and so
+// is one whose faces index past its arrays.
+class MeshCache
+{
+    public:
+        static const std::uint32_t VERSION = 2;
+
+        static std::string GetCachePath(const char *p_sourcePath);
+
+        // Maps the cache of 'p_sourcePath' into 'cache' and points 'arrays'
+        // into the mapping. Returns false when the cache is missing, broken
+        // or stale.
+        static bool Load(const char *p_sourcePath, MappedFile &cache, MeshArrays &arrays);
+
+        // Writes the cache for a source whose contents are 'source'.
+        static bool Save(const char *p_sourcePath, const char *source, std::size_t source_size,
+                         const MeshArrays &arrays);
+
+        static std::uint64_t Checksum(const char *data, std::size_t size);
+};
@@ -1,31 +1,27 @@
+#include <algorithm>
 #include <iostream>
-#include <cctype>
-#include <regex>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
 #include <stdexcept>
-#include <fstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include "obj_model.h"
+#include "obj_parser.h"
+#include "mapped_file.h"
+#include "profiler.h"
+#include "thread_pool.h"
 
-static
-std::string &rtrim(std::string &str)
+namespace
 {
-    auto f = [](unsigned char const c) { return std::isgraph(c); };
-    str.erase(std::find_if(str.rbegin(), str.rend(), f).base(), str.end());
-    return str;
-}
 
-static
-std::string &ltrim(std::string &str)
+template <typename T>
+void append(std::vector<T> &to, const std::vector<T> &from)
 {
-    auto f = [](unsigned char const c) { return std::isgraph(c); };
-    str.erase(str.begin(), std::find_if(str.begin(), str.end(), f));
-    return str;
+    to.insert(to.end(), from.begin(), from.end());
 }
 
-static
-std::string &trim(std::string &str)
-{
-    return rtrim(ltrim(str));
 }
 
 static
@@ -40,31 +36,16 @@ void concatinate_syserrmsg(std::string &errMsg)
     errMsg += sys_err_msg;
 }
 
-bool ObjModel::LoadDiffuseTexture(const char *p_filePath)
+ObjModel::ObjModel(const char *p_filePath, bool use_cache)
 {
-    if (!_DiffuseTexture.read_tga_file(p_filePath))
+    PROFILE_SCOPE(STAGE_MESH_LOAD);
+    if (use_cache && MeshCache::Load(p_filePath, _Cache, _Mesh))
     {
-        return false;
+        return;
     }
-    _DiffuseTexture.flip_vertically();
-    return true;
-}
-
-TGAColor ObjModel::GetColor(unsigned long x, unsigned long y)
-{
-    return _DiffuseTexture.get(x, y);
-}
-
-Vector2l ObjModel::GetVertexTexture(unsigned long i)
-{
-    return Vector2l(std::round(_VerticesTexture[i].x * _DiffuseTexture.get_width()),
-                    std::round(_VerticesTexture[i].y * _DiffuseTexture.get_height()));
-}
 
-ObjModel::ObjModel(const char *p_filePath)
-{
-    std::fstream in_file(p_filePath, std::ios_base::in);
-    if (in_file.fail())
+    MappedFile in_file;
+    if (!in_file.Open(p_filePath))
     {
         std::string err_msg;
         err_msg += "Can not open file '";
@@ -74,164 +55,93 @@ ObjModel::ObjModel(const char *p_filePath)
         throw std::runtime_error(err_msg);
     }
 
-    std::string line;
-    unsigned long line_number = 0;
-    while (std::getline(in_file, line))
+    Parse(in_file.GetData(), in_file.GetSize());
+
+    _Mesh.vertices = _VerticesGeometric;
+    _Mesh.textures = _VerticesTexture;
+    _Mesh.normals = _VerticesNormals;
+    _Mesh.face_v = _FacesVertex;
+    _Mesh.face_vt = _FacesTexture;
+    _Mesh.face_vn = _FacesNormal;
+
+    if (use_cache && !MeshCache::Save(p_filePath, in_file.GetData(), in_file.GetSize(), _Mesh))
     {
-        line_number++;
-        trim(line);
+        std::cerr << "Warning: can't write mesh cache " << MeshCache::GetCachePath(p_filePath) << std::endl;
+    }
+}
 
-        if (line.empty() || line[0] == '#')
-        {
-            continue;
-        }
+void ObjModel::Parse(const char *data, std::size_t size)
+{
+    // Big files are cut into newline-aligned slices parsed in parallel.
+    const std::size_t min_chunk_size = 1 << 20;
+    std::size_t chunks_count = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    chunks_count = std::max<std::size_t>(1, std::min(chunks_count, size / min_chunk_size));
 
-        std::istringstream stream(line);
+    std::vector<ObjChunk> chunks;
+    split_obj_chunks(data, size, chunks_count, chunks);
 
-        if (line[0] == 'v' && std::isspace(line[1]))
-        {
-            stream.ignore(2);
-            std::vector<float> values(std::istream_iterator<float>{stream},
-                                      std::istream_iterator<float>{});
-
-            if (values.size() != 3 || !stream.eof())
-            {
-                std::cout << "Error: worng input on line " << line_number << std::endl;
-            }
-            else
-            {
-                Vector3f v(values[0], values[1], values[2]);
-                _VerticesGeometric.push_back(v);
-            }
-        }
-        else if (line[0] == 'v' && line[1] == 't' && std::isspace(line[2]))
-        {
-            stream.ignore(3);
-            std::vector<float> values(std::istream_iterator<float>{stream},
-                                      std::istream_iterator<float>{});
-
-            if (values.size() != 3 || !stream.eof())
-            {
-                std::cout << "Error: worng input on line " << line_number << std::endl;
-            }
-            else
-            {
-                Vector2f v(values[0], values[1]);
-                _VerticesTexture.push_back(v);
-            }
-        }
-        else if (line[0] == 'v' && line[1] == 'n' && std::isspace(line[2]))
-        {
-            stream.ignore(3);
-            std::vector<float> values(std::istream_iterator<float>{stream},
-                                      std::istream_iterator<float>{});
-
-            if (values.size() != 3 || !stream.eof())
-            {
-                std::cout << "Error: worng input on line " << line_number << std::endl;
-            }
-            else
-            {
-                Vector3f v(values[0], values[1], values[2]);
-                _VerticesNormals.push_back(v);
-            }
-        }
-        else if (line[0] == 'f' && std::isspace(line[1]))
+    ThreadPool pool(chunks_count);
+    pool.ParallelFor(chunks_count, [&chunks](std::size_t i) { parse_obj_chunk(chunks[i]); });
+
+    std::size_t vertices = 0, textures = 0, normals = 0, corners = 0;
+    for (const ObjChunk &chunk : chunks)
+    {
+        vertices += chunk.vertices.size();
+        textures += chunk.textures.size();
+        normals += chunk.normals.size();
+        corners += chunk.face_v.size();
+    }
+    _VerticesGeometric.reserve(vertices);
+    _VerticesTexture.reserve(textures);
+    _VerticesNormals.reserve(normals);
+    _FacesVertex.reserve(corners);
+    _FacesTexture.reserve(corners);
+    _FacesNormal.reserve(corners);
+
+    for (const ObjChunk &chunk : chunks)
+    {
+        append(_VerticesGeometric, chunk.vertices);
+        append(_VerticesTexture, chunk.textures);
+        append(_VerticesNormals, chunk.normals);
+    }
+
+    // A face may use vertices of any slice, so the indices are only checked
+    // now. A slice holding a bad one is parsed again with the counts, which
+    // drops and reports its bad faces like ObjStream does.
+    for (ObjChunk &chunk : chunks)
+    {
+        MeshArrays arrays;
+        arrays.vertices = _VerticesGeometric;
+        arrays.textures = _VerticesTexture;
+        arrays.normals = _VerticesNormals;
+        arrays.face_v = chunk.face_v;
+        arrays.face_vt = chunk.face_vt;
+        arrays.face_vn = chunk.face_vn;
+        if (!check_face_indices(arrays))
         {
-            stream.ignore(2);
-
-            std::vector<unsigned long> v_indexes;
-            std::vector<unsigned long> vn_indexes;
-            std::vector<unsigned long> vt_indexes;
-
-            bool error = false;
-            while (true)
-            {
-                unsigned long v_index;
-                stream >> v_index;
-                if (stream.eof())
-                {
-                    if (!stream.fail())
-                    {
-                        v_indexes.push_back(--v_index);
-                    }
-                    break;
-                }
-                else if (stream.fail())
-                {
-                    error = true;
-                    break;
-                }
-                v_indexes.push_back(--v_index);
-
-                if (stream.peek() == '/')
-                {
-                    stream.ignore(1);
-                    if (stream.peek() == '/')
-                    {
-                        // v//vn
-                        stream.ignore(1);
-                        unsigned long vn_index;
-                        stream >> vn_index;
-                        vn_indexes.push_back(--vn_index);
-                        if (stream.fail())
-                        {
-                            error = true;
-                            break;
-                        }
-                    }
-                    else
-                    {
-                        // v/vt
-                        unsigned long vt_index;
-                        stream >> vt_index;
-                        vt_indexes.push_back(--vt_index);
-                        if (stream.fail())
-                        {
-                            error = true;
-                            break;
-                        }
-
-                        if (stream.peek() == '/')
-                        {
-                            // v/vt/vn
-                            stream.ignore(1);
-                            unsigned long vn_index;
-                            stream >> vn_index;
-                            vn_indexes.push_back(--vn_index);
-                            if (stream.fail())
-                            {
-                                error = true;
-                                break;
-                            }
-                        }
-                    }
-                }
-            }
-            if ((vt_indexes.size() != 0 && vt_indexes.size() != v_indexes.size())
-                || (vn_indexes.size() != 0 && vn_indexes.size() != v_indexes.size())
-                || v_indexes.size() < 3)
-            {
-                error = true;
-            }
-            if (error)
-            {
-                std::cout << "Error: worng input on line " << line_number << std::endl;
-            }
-            else
-            {
-                _FacesVertex.push_back(v_indexes);
-                _FacesNormal.push_back(vn_indexes);
-                _FacesTexture.push_back(vt_indexes);
-            }
+            ObjChunk checked;
+            checked.begin = chunk.begin;
+            checked.end = chunk.end;
+            checked.vertices_count = _VerticesGeometric.size();
+            checked.textures_count = _VerticesTexture.size();
+            checked.normals_count = _VerticesNormals.size();
+            parse_obj_chunk(checked);
+            chunk = std::move(checked);
         }
     }
-    if (!in_file.eof())
+
+    unsigned long first_line = 0;
+    for (const ObjChunk &chunk : chunks)
     {
-        std::string err_msg;
-        err_msg += "Can not read line from file.";
-        concatinate_syserrmsg(err_msg);
-        throw std::runtime_error(err_msg);
+        for (unsigned long line_number : chunk.error_lines)
+        {
+            std::cout << "Error: worng input on line " << first_line + line_number << std::endl;
+        }
+        first_line += chunk.lines;
+
+        append(_FacesVertex, chunk.face_v);
+        append(_FacesTexture, chunk.face_vt);
+        append(_FacesNormal, chunk.face_vn);
     }
 }
 
@@ -1,35 +1,61 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include "geometry.h"
-#include "tgaimage.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
 
 class ObjModel
 {
     public:
-        ObjModel(const char *p_filePath);
+        // Index stored for a missing texture or normal reference of a face corner.
+        static const std::uint32_t NO_INDEX = 0xffffffff;
+
+        // With 'use_cache' the model is loaded from its MeshCache when that
+        // is up to date, and the cache is (re)written after parsing otherwise.
+        ObjModel(const char *p_filePath, bool use_cache = true);
         ~ObjModel();
 
-        bool LoadDiffuseTexture(const char *p_filePath);
-        TGAColor GetColor(unsigned long x, unsigned long y);
+        ObjModel(const ObjModel &) = delete;
+        ObjModel &operator=(const ObjModel &) = delete;
+
+        bool IsLoadedFromCache() const { return _Cache.IsOpen(); }
 
-        Vector3f GetVertexGeometric(unsigned long i) { return _VerticesGeometric[i]; }
-        Vector3f GetVertexNormal(unsigned long i)    { return _VerticesNormals[i]; }
-        Vector2l GetVertexTexture(unsigned long i);
+        const Vector3f &GetVertexGeometric(unsigned long i) const { return _Mesh.vertices[i]; }
+        const Vector3f &GetVertexNormal(unsigned long i) const    { return _Mesh.normals[i]; }
+        const Vector2f &GetVertexTexture(unsigned long i) const   { return _Mesh.textures[i]; }
 
-        std::size_t GetFacesCount()    { return _FacesVertex.size(); }
-        std::vector<unsigned long> GetFaceVertices(unsigned long i) { return _FacesVertex[i]; }
-        std::vector<unsigned long> GetFaceTextures(unsigned long i) { return _FacesTexture[i];}
-        std::vector<unsigned long> GetFaceNormals(unsigned long i)  { return _FacesNormal[i]; }
+        // Polygons are triangulated on load, so every face has 3 corners.
+        // The face accessors return views into the index buffers; a face
+        // without texture or normal references gets an empty view.
+        std::size_t GetFacesCount() const { return _Mesh.face_v.size() / 3; }
+        ArrayView<std::uint32_t> GetFaceVertices(unsigned long i) const { return GetFaceIndices(_Mesh.face_v, i); }
+        ArrayView<std::uint32_t> GetFaceTextures(unsigned long i) const { return GetFaceIndices(_Mesh.face_vt, i);}
+        ArrayView<std::uint32_t> GetFaceNormals(unsigned long i) const  { return GetFaceIndices(_Mesh.face_vn, i); }
+
+        const MeshArrays &GetMeshArrays() const { return _Mesh; }
 
     private:
+        void Parse(const char *data, std::size_t size);
+
+        static ArrayView<std::uint32_t> GetFaceIndices(const ArrayView<std::uint32_t> &indices, unsigned long i)
+        {
+            const std::uint32_t *face = indices.data() + 3 * i;
+            return ArrayView<std::uint32_t>(face, face[0] == NO_INDEX ? 0 : 3);
+        }
+
+        // Everything is read through these views. They point either into
+        // the vectors below or into the mapped cache file.
+        MeshArrays _Mesh;
+        MappedFile _Cache;
+
         std::vector<Vector3f> _VerticesGeometric;
         std::vector<Vector2f> _VerticesTexture;
         std::vector<Vector3f> _VerticesNormals;
 
-        std::vector<std::vector<unsigned long> > _FacesVertex;
-        std::vector<std::vector<unsigned long> > _FacesTexture;
-        std::vector<std::vector<unsigned long> > _FacesNormal;
-
-        TGAImage _DiffuseTexture;
+        // Triangle corners, face i is [3 * i, 3 * i + 3) in each array.
+        std::vector<std::uint32_t> _FacesVertex;
+        std::vector<std::uint32_t> _FacesTexture;
+        std::vector<std::uint32_t> _FacesNormal;
 };
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include "obj_parser.h"
+
+namespace
+{
+
+const double POWERS_OF_TEN[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline void skip_spaces(const char *&p, const char *end)
+{
+    while (p < end && std::isspace((unsigned char)*p))
+    {
+        p++;
+    }
+}
+
+// Parses [+-]digits[.digits][(e|E)[+-]digits] without allocating.
+bool parse_float(const char *&p, const char *end, float &value)
+{
+    const char *s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+    {
+        negative = (*s == '-');
+        s++;
+    }
+
+    std::uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    for (; s < end && is_digit(*s); s++, digits++)
+    {
+        if (mantissa < 100000000000000000ULL)
+        {
+            mantissa = mantissa * 10 + (*s - '0');
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+    if (s < end && *s == '.')
+    {
+        s++;
+        for (; s < end && is_digit(*s); s++, digits++)
+        {
+            if (mantissa < 100000000000000000ULL)
+            {
+                mantissa = mantissa * 10 + (*s - '0');
+                exponent--;
+            }
+        }
+    }
+    if (digits == 0)
+    {
+        return false;
+    }
+    if (s < end && (*s == 'e' || *s == 'E'))
+    {
+        const char *e = s + 1;
+        bool exp_negative = false;
+        if (e < end && (*e == '-' || *e == '+'))
+        {
+            exp_negative = (*e == '-');
+            e++;
+        }
+        if (e < end && is_digit(*e))
+        {
+            int exp_value = 0;
+            for (; e < end && is_digit(*e); e++)
+            {
+                if (exp_value < 10000)
+                {
+                    exp_value = exp_value * 10 + (*e - '0');
+                }
+            }
+            exponent += exp_negative ? -exp_value : exp_value;
+            s = e;
+        }
+    }
+
+    double result = (double)mantissa;
+    if (exponent < 0)
+    {
+        for (; exponent < -22; exponent += 22)
+        {
+            result /= POWERS_OF_TEN[22];
+        }
+        result /= POWERS_OF_TEN[-exponent];
+    }
+    else
+    {
+        for (; exponent > 22; exponent -= 22)
+        {
+            result *= POWERS_OF_TEN[22];
+        }
+        result *= POWERS_OF_TEN[exponent];
+    }
+    value = (float)(negative ? -result : result);
+    p = s;
+    return true;
+}
+
+// Parses a 1-based OBJ index and returns it 0-based.
+bool parse_index(const char *&p, const char *end, std::uint32_t &index)
+{
+    const char *s = p;
+    std::uint64_t value = 0;
+    for (; s < end && is_digit(*s); s++)
+    {
+        value = value * 10 + (*s - '0');
+        if (value > ObjModel::NO_INDEX)
+        {
+            return false;
+        }
+    }
+    if (s == p || value == 0)
+    {
+        return false;
+    }
+    index = value - 1;
+    p = s;
+    return true;
+}
+
+// Reads exactly 'count' whitespace separated floats up to the end of the
+// line. Fails on anything that is not a number or on extra values.
+bool parse_floats(const char *p, const char *end, float *values, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        skip_spaces(p, end);
+        if (!parse_float(p, end, values[i]) || (p < end && !std::isspace((unsigned char)*p)))
+        {
+            return false;
+        }
+    }
+    skip_spaces(p, end);
+    return p == end;
+}
+
+// Parses a polygon and appends it to the chunk as a triangle fan.
+bool parse_face(const char *p, const char *end, ObjChunk &chunk)
+{
+    chunk.polygon_v.clear();
+    chunk.polygon_vt.clear();
+    chunk.polygon_vn.clear();
+    std::uint32_t vertices = 0;
+    std::uint32_t textures = 0;
+    std::uint32_t normals = 0;
+
+    while (true)
+    {
+        skip_spaces(p, end);
+        if (p == end)
+        {
+            break;
+        }
+
+        std::uint32_t v = 0;
+        std::uint32_t vt = ObjModel::NO_INDEX;
+        std::uint32_t vn = ObjModel::NO_INDEX;
+        if (!parse_index(p, end, v))
+        {
+            return false;
+        }
+        if (p < end && *p == '/')
+        {
+            p++;
+            if (p < end && *p == '/')
+            {
+                // v//vn
+                p++;
+                if (!parse_index(p, end, vn))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                // v/vt
+                if (!parse_index(p, end, vt))
+                {
+                    return false;
+                }
+                if (p < end && *p == '/')
+                {
+                    // v/vt/vn
+                    p++;
+                    if (!parse_index(p, end, vn))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+        if ((p < end && !std::isspace((unsigned char)*p)) || v >= chunk.vertices_count ||
+            (vt != ObjModel::NO_INDEX && vt >= chunk.textures_count) ||
+            (vn != ObjModel::NO_INDEX && vn >= chunk.normals_count))
+        {
+            return false;
+        }
+
+        chunk.polygon_v.push_back(v);
+        chunk.polygon_vt.push_back(vt);
+        chunk.polygon_vn.push_back(vn);
+        vertices++;
+        textures += (vt != ObjModel::NO_INDEX);
+        normals += (vn != ObjModel::NO_INDEX);
+    }
+
+    if ((textures != 0 && textures != vertices)
+        || (normals != 0 && normals != vertices)
+        || vertices < 3)
+    {
+        return false;
+    }
+
+    for (std::uint32_t i = 1; i + 1 < vertices; i++)
+    {
+        const std::uint32_t corners[3] = {0, i, i + 1};
+        for (std::uint32_t corner : corners)
+        {
+            chunk.face_v.push_back(chunk.polygon_v[corner]);
+            chunk.face_vt.push_back(chunk.polygon_vt[corner]);
+            chunk.face_vn.push_back(chunk.polygon_vn[corner]);
+        }
+    }
+    return true;
+}
+
+}
+
+void parse_obj_chunk(ObjChunk &chunk)
+{
+    const char *p = chunk.begin;
+    while (p < chunk.end)
+    {
+        const char *line_end = static_cast<const char *>(std::memchr(p, '\n', chunk.end - p));
+        if (!line_end)
+        {
+            line_end = chunk.end;
+        }
+        const char *line_begin = p;
+        const char *begin = p;
+        const char *end = line_end;
+        p = line_end + 1;
+        chunk.lines++;
+
+        // trim everything that is not a visible character on both sides
+        while (begin < end && !std::isgraph((unsigned char)*begin))
+        {
+            begin++;
+        }
+        while (end > begin && !std::isgraph((unsigned char)end[-1]))
+        {
+            end--;
+        }
+        std::size_t length = end - begin;
+        if (length == 0 || begin[0] == '#')
+        {
+            continue;
+        }
+
+        bool error = false;
+        if (begin[0] == 'v' && !(chunk.records & OBJ_VERTICES))
+        {
+            continue;
+        }
+        if (length > 1 && begin[0] == 'v' && std::isspace((unsigned char)begin[1]))
+        {
+            float values[3];
+            error = !parse_floats(begin + 2, end, values, 3);
+            if (!error)
+            {
+                chunk.vertices.push_back(Vector3f(values[0], values[1], values[2]));
+            }
+        }
+        else if (length > 2 && begin[0] == 'v' && begin[1] == 't' && std::isspace((unsigned char)begin[2]))
+        {
+            float values[3];
+            error = !parse_floats(begin + 3, end, values, 3);
+            if (!error)
+            {
+                chunk.textures.push_back(Vector2f(values[0], values[1]));
+            }
+        }
+        else if (length > 2 && begin[0] == 'v' && begin[1] == 'n' && std::isspace((unsigned char)begin[2]))
+        {
+            float values[3];
+            error = !parse_floats(begin + 3, end, values, 3);
+            if (!error)
+            {
+                chunk.normals.push_back(Vector3f(values[0], values[1], values[2]));
+            }
+        }
+        else if (length > 1 && begin[0] == 'f' && std::isspace((unsigned char)begin[1]))
+        {
+            if (!chunk.first_face)
+            {
+                chunk.first_face = line_begin;
+            }
+            if (chunk.records & OBJ_FACES)
+            {
+                error = !parse_face(begin + 2, end, chunk);
+            }
+        }
+
+        if (error)
+        {
+            chunk.error_lines.push_back(chunk.lines);
+        }
+        if (chunk.face_v.size() >= chunk.max_corners && p < chunk.end)
+        {
+            chunk.end = p;
+        }
+    }
+}
+
+void split_obj_chunks(const char *data, std::size_t size, std::size_t count, std::vector<ObjChunk> &chunks)
+{
+    chunks.resize(count);
+    const char *chunk_begin = data;
+    for (std::size_t i = 0; i < count; i++)
+    {
+        const char *chunk_end = data + size;
+        if (i + 1 < count)
+        {
+            chunk_end = std::max(chunk_begin, data + size * (i + 1) / count);
+            const char *newline = static_cast<const char *>(std::memchr(chunk_end, '\n', data + size - chunk_end));
+            chunk_end = newline ? newline + 1 : data + size;
+        }
+        chunks[i].begin = chunk_begin;
+        chunks[i].end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "geometry.h"
+#include "obj_model.h"
+
+// Record types of an OBJ file, for ObjChunk::records.
+enum ObjRecords
+{
+    OBJ_VERTICES = 1,   // v, vt and vn lines
+    OBJ_FACES = 2,      // f lines
+    OBJ_ALL = OBJ_VERTICES | OBJ_FACES
+};
+
+// Everything parsed from one newline-aligned slice of an OBJ file. Slices
+// are parsed independently and appended to the model in file order.
+struct ObjChunk
+{
+    ObjChunk() : begin(nullptr), end(nullptr), records(OBJ_ALL),
+                 max_corners(std::numeric_limits<std::size_t>::max()), vertices_count(ObjModel::NO_INDEX),
+                 textures_count(ObjModel::NO_INDEX), normals_count(ObjModel::NO_INDEX), first_face(nullptr),
+                 lines(0) {};
+
+    const char *begin;
+    const char *end;
+    // Records of the other types are skipped without being parsed.
+    int records;
+    // Parsing stops after the line that brings the faces to this many
+    // corners, with 'end' moved to the first line left unparsed.
+    std::size_t max_corners;
+    // Face indices at or past these counts are errors.
+    std::uint32_t vertices_count;
+    std::uint32_t textures_count;
+    std::uint32_t normals_count;
+
+    // First face line of the slice, parsed or not; nullptr without one.
+    const char *first_face;
+    unsigned long lines;
+
+    std::vector<Vector3f> vertices;
+    std::vector<Vector2f> textures;
+    std::vector<Vector3f> normals;
+
+    // Triangle corners, three per face.
+    std::vector<std::uint32_t> face_v;
+    std::vector<std::uint32_t> face_vt;
+    std::vector<std::uint32_t> face_vn;
+
+    // Scratch space for the polygon being parsed, reused between lines.
+    std::vector<std::uint32_t> polygon_v;
+    std::vector<std::uint32_t> polygon_vt;
+    std::vector<std::uint32_t> polygon_vn;
+
+    // Lines of the slice, counted from 1, that failed to parse.
+    std::vector<unsigned long> error_lines;
+};
+
+// Parses [chunk.begin, chunk.end) into the chunk. Polygons are triangulated
+// as fans.
+void parse_obj_chunk(ObjChunk &chunk);
+
+// Cuts [data, data + size) into 'count' slices of about equal size, each
+// ending after a newline, and points 'chunks' at them.
+void split_obj_chunks(const char *data, std::size_t size, std::size_t count, std::vector<ObjChunk> &chunks);
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "obj_stream.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+namespace
+{
+
+// Bytes of the file every thread parses per round of the vertex pass.
+const std::size_t VERTEX_SLICE_SIZE = 8 << 20;
+
+void append(Vector3Array &to, const std::vector<Vector3f> &from)
+{
+    std::size_t size = to.size();
+    to.resize(size + from.size());
+    for (std::size_t i = 0; i < from.size(); i++)
+    {
+        to.x[size + i] = from[i].x;
+        to.y[size + i] = from[i].y;
+        to.z[size + i] = from[i].z;
+    }
+}
+
+void report_errors(const ObjChunk &chunk, unsigned long first_line)
+{
+    for (unsigned long line_number : chunk.error_lines)
+    {
+        std::cout << "Error: worng input on line " << first_line + line_number << std::endl;
+    }
+}
+
+}
+
+ObjStream::ObjStream(const char *p_filePath, std::size_t chunk_corners)
+    : _ChunkCorners(std::max<std::size_t>(chunk_corners, 3)), _Radius(0), _FacesOffset(0), _FacesLine(0),
+      _Chunks(CHUNKS_IN_FLIGHT), _Current(nullptr), _Line(0), _Finished(true), _Stop(false)
+{
+    PROFILE_SCOPE(STAGE_MESH_LOAD);
+    if (!_File.Open(p_filePath))
+    {
+        throw std::runtime_error(std::string("Can not open file '") + p_filePath + "'. " + std::strerror(errno));
+    }
+    const char *data = _File.GetData();
+    const char *data_end = data + _File.GetSize();
+    _FacesOffset = _File.GetSize();
+
+    // Vertex pass: rounds of one newline-aligned slice per thread, parsed
+    // in parallel and dropped from memory once appended.
+    ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<ObjChunk> slices;
+    unsigned long lines_before = 0;
+    bool faces_found = false;
+    for (const char *begin = data; begin < data_end;)
+    {
+        const char *end = data_end;
+        if ((std::size_t)(data_end - begin) > VERTEX_SLICE_SIZE * pool.GetThreadsCount())
+        {
+            end = begin + VERTEX_SLICE_SIZE * pool.GetThreadsCount();
+            const char *newline = static_cast<const char *>(std::memchr(end, '\n', data_end - end));
+            end = newline ? newline + 1 : data_end;
+        }
+        slices.clear();
+        split_obj_chunks(begin, end - begin, pool.GetThreadsCount(), slices);
+        for (ObjChunk &slice : slices)
+        {
+            slice.records = OBJ_VERTICES;
+        }
+        pool.ParallelFor(slices.size(), [&slices](std::size_t i) { parse_obj_chunk(slices[i]); });
+
+        for (const ObjChunk &slice : slices)
+        {
+            report_errors(slice, lines_before);
+            if (slice.first_face && !faces_found)
+            {
+                faces_found = true;
+                _FacesOffset = slice.first_face - data;
+                _FacesLine = lines_before + std::count(slice.begin, slice.first_face, '\n');
+            }
+            lines_before += slice.lines;
+            append(_Vertices, slice.vertices);
+            _Textures.insert(_Textures.end(), slice.textures.begin(), slice.textures.end());
+            append(_Normals, slice.normals);
+        }
+        _File.Discard(begin, end);
+        begin = end;
+    }
+
+    if (_Vertices.size() > 0)
+    {
+        float min[3], max[3];
+        const std::vector<float> *axes[3] = {&_Vertices.x, &_Vertices.y, &_Vertices.z};
+        for (int i = 0; i < 3; i++)
+        {
+            min[i] = *std::min_element(axes[i]->begin(), axes[i]->end());
+            max[i] = *std::max_element(axes[i]->begin(), axes[i]->end());
+        }
+        // the farthest corner takes the coordinate of larger magnitude on
+        // every axis
+        Vector3f corner(std::max(std::abs(min[0]), std::abs(max[0])), std::max(std::abs(min[1]), std::abs(max[1])),
+                        std::max(std::abs(min[2]), std::abs(max[2])));
+        _Radius = corner.len();
+    }
+}
+
+ObjStream::~ObjStream()
+{
+    Stop();
+}
+
+void ObjStream::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_Mutex);
+        _Stop = true;
+    }
+    _Changed.notify_all();
+    if (_Reader.joinable())
+    {
+        _Reader.join();
+    }
+    _Free.clear();
+    _Parsed.clear();
+    _Current = nullptr;
+    _Finished = true;
+}
+
+void ObjStream::Rewind()
+{
+    Stop();
+    for (ObjChunk &chunk : _Chunks)
+    {
+        _Free.push_back(&chunk);
+    }
+    _Line = _FacesLine;
+    _Finished = false;
+    _Stop = false;
+    _Reader = std::thread(&ObjStream::ReadFaces, this);
+}
+
+const ObjChunk *ObjStream::Next()
+{
+    std::unique_lock<std::mutex> lock(_Mutex);
+    if (_Current)
+    {
+        _Line += _Current->lines;
+        _Free.push_back(_Current);
+        _Current = nullptr;
+        _Changed.notify_all();
+    }
+    _Changed.wait(lock, [this]() { return !_Parsed.empty() || _Finished; });
+    if (_Parsed.empty())
+    {
+        return nullptr;
+    }
+    _Current = _Parsed.front();
+    _Parsed.pop_front();
+    lock.unlock();
+
+    report_errors(*_Current, _Line);
+    return _Current;
+}
+
+void ObjStream::ReadFaces()
+{
+    const char *data_end = _File.GetData() + _File.GetSize();
+    const char *cursor = _File.GetData() + _FacesOffset;
+    while (cursor < data_end)
+    {
+        ObjChunk *chunk = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(_Mutex);
+            _Changed.wait(lock, [this]() { return _Stop || !_Free.empty(); });
+            if (_Stop)
+            {
+                return;
+            }
+            chunk = _Free.back();
+            _Free.pop_back();
+        }
+
+        {
+            PROFILE_SCOPE(STAGE_MESH_LOAD);
+            // the arrays keep their capacity from chunk to chunk
+            chunk->begin = cursor;
+            chunk->end = data_end;
+            chunk->records = OBJ_FACES;
+            chunk->max_corners = _ChunkCorners;
+            chunk->vertices_count = _Vertices.size();
+            chunk->textures_count = _Textures.size();
+            chunk->normals_count = _Normals.size();
+            chunk->first_face = nullptr;
+            chunk->lines = 0;
+            chunk->face_v.clear();
+            chunk->face_vt.clear();
+            chunk->face_vn.clear();
+            chunk->error_lines.clear();
+            parse_obj_chunk(*chunk);
+            _File.Discard(cursor, chunk->end);
+            cursor = chunk->end;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_Mutex);
+            _Parsed.push_back(chunk);
+        }
+        _Changed.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_Mutex);
+        _Finished = true;
+    }
+    _Changed.notify_all();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "geometry.h"
+#include "mapped_file.h"
+#include "obj_parser.h"
+
+// Out-of-core reader for OBJ files too large to be held as an ObjModel.
+// The constructor reads and keeps the vertex attributes only. Each pass
+// then reads the faces again in chunks of a bounded number of corners. A
+// background thread parses the next chunk while the caller draws the
+// current one. File pages are dropped as soon as they are parsed, so a pass
+// holds at most CHUNKS_IN_FLIGHT chunks besides the vertex attributes.
+class ObjStream
+{
+    public:
+        // One chunk with the caller, up to two parsed ahead of it.
+        static const int CHUNKS_IN_FLIGHT = 3;
+
+        // A chunk is cut after the line that brings it to 'chunk_corners'
+        // triangle corners. Throws std::runtime_error when the file can not
+        // be opened.
+        ObjStream(const char *p_filePath, std::size_t chunk_corners);
+        ~ObjStream();
+
+        ObjStream(const ObjStream &) = delete;
+        ObjStream &operator=(const ObjStream &) = delete;
+
+        const Vector3Array &GetVertices() const          { return _Vertices; }
+        const std::vector<Vector2f> &GetTextures() const { return _Textures; }
+        const Vector3Array &GetNormals() const           { return _Normals; }
+
+        // Distance from the origin of the farthest corner of the vertices'
+        // bounding box.
+        float GetRadius() const { return _Radius; }
+
+        // Starts a pass over the faces, abandoning the previous one.
+        void Rewind();
+
+        // Next chunk of the pass, valid until the following call; nullptr
+        // once the pass is over. Only face_v, face_vt and face_vn are
+        // filled. Lines that fail to parse are reported on stdout.
+        const ObjChunk *Next();
+
+    private:
+        void Stop();
+        void ReadFaces();
+
+        MappedFile _File;
+        std::size_t _ChunkCorners;
+
+        Vector3Array _Vertices;
+        std::vector<Vector2f> _Textures;
+        Vector3Array _Normals;
+        float _Radius;
+
+        // Where the first face line is, in bytes and in lines.
+        std::size_t _FacesOffset;
+        unsigned long _FacesLine;
+
+        std::vector<ObjChunk> _Chunks;
+        std::thread _Reader;
+        std::mutex _Mutex;
+        std::condition_variable _Changed;
+        // Chunks the reader may parse into, and parsed ones in file order.
+        std::vector<ObjChunk *> _Free;
+        std::deque<ObjChunk *> _Parsed;
+        ObjChunk *_Current;
+        // Line of the file the current chunk starts on.
+        unsigned long _Line;
+        bool _Finished;
+        bool _Stop;
+};
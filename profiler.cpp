@@ -0,0 +1,80 @@
+#ifdef ENABLE_PROFILING
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "profiler.h"
+
+namespace profiler
+{
+
+namespace
+{
+
+const char *STAGE_NAMES[STAGES_COUNT] = {
+    "mesh_load", "texture_load", "vertex", "raster", "tga_write"
+};
+
+const char *COUNTER_NAMES[COUNTERS_COUNT] = {
+    "triangles_submitted", "triangles_culled", "triangles_degenerate", "triangles_backfacing", "triangles_clipped",
+    "pixels_tested", "depth_passes", "texels_fetched", "pixels_covered"
+};
+
+std::atomic<long long> stage_nanoseconds[STAGES_COUNT];
+std::atomic<unsigned long> stage_calls[STAGES_COUNT];
+std::atomic<unsigned long> counters[COUNTERS_COUNT];
+std::string report_path;
+
+void dump()
+{
+    std::FILE *out = std::fopen(report_path.c_str(), "w");
+    if (!out)
+    {
+        std::perror(report_path.c_str());
+        return;
+    }
+
+    std::fprintf(out, "{\n  \"stages\": {\n");
+    for (int i = 0; i < STAGES_COUNT; i++)
+    {
+        std::fprintf(out, "    \"%s\": {\"seconds\": %.6f, \"calls\": %lu}%s\n", STAGE_NAMES[i],
+                     stage_nanoseconds[i].load() * 1e-9, stage_calls[i].load(), i + 1 < STAGES_COUNT ? "," : "");
+    }
+    std::fprintf(out, "  },\n  \"counters\": {\n");
+    for (int i = 0; i < COUNTERS_COUNT; i++)
+    {
+        std::fprintf(out, "    \"%s\": %lu,\n", COUNTER_NAMES[i], counters[i].load());
+    }
+    unsigned long covered = counters[PIXELS_COVERED].load();
+    double overdraw = covered ? (double)counters[DEPTH_PASSES].load() / covered : 0.;
+    std::fprintf(out, "    \"overdraw_ratio\": %.4f\n  }\n}\n", overdraw);
+    std::fclose(out);
+}
+
+}
+
+void Init(const char *p_filePath)
+{
+    if (!report_path.empty())
+    {
+        return;
+    }
+    report_path = p_filePath;
+    std::atexit(dump);
+}
+
+void AddTime(Stage stage, std::chrono::steady_clock::duration elapsed)
+{
+    stage_nanoseconds[stage].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                                       std::memory_order_relaxed);
+    stage_calls[stage].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Add(Counter counter, unsigned long value)
+{
+    counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+}
+
+#endif
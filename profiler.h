@@ -0,0 +1,75 @@
+#pragma once
+
+// Hot-path instrumentation: wall time per pipeline stage and raster counters,
+// written as JSON when the process exits.
+//
+// Everything is reached through the PROFILE_* macros, which expand to nothing
+// unless the build defines ENABLE_PROFILING (cmake -DENABLE_PROFILING=ON).
+
+#ifdef ENABLE_PROFILING
+
+#include <atomic>
+#include <chrono>
+
+namespace profiler
+{
+
+enum Stage
+{
+    STAGE_MESH_LOAD,
+    STAGE_TEXTURE_LOAD,
+    STAGE_VERTEX,
+    STAGE_RASTER,
+    STAGE_TGA_WRITE,
+    STAGES_COUNT
+};
+
+enum Counter
+{
+    TRIANGLES_SUBMITTED,
+    TRIANGLES_CULLED,
+    TRIANGLES_DEGENERATE,
+    TRIANGLES_BACKFACING,
+    TRIANGLES_CLIPPED,
+    PIXELS_TESTED,
+    DEPTH_PASSES,
+    TEXELS_FETCHED,
+    PIXELS_COVERED,
+    COUNTERS_COUNT
+};
+
+// Writes the report to 'p_filePath' at exit. Only the first call counts.
+void Init(const char *p_filePath);
+
+void AddTime(Stage stage, std::chrono::steady_clock::duration elapsed);
+void Add(Counter counter, unsigned long value);
+
+class ScopedTimer
+{
+    public:
+        explicit ScopedTimer(Stage stage) : _Stage(stage), _Start(std::chrono::steady_clock::now()) {};
+        ~ScopedTimer() { AddTime(_Stage, std::chrono::steady_clock::now() - _Start); }
+
+    private:
+        Stage _Stage;
+        std::chrono::steady_clock::time_point _Start;
+};
+
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#define PROFILE_INIT(path)          profiler::Init(path)
+#define PROFILE_SCOPE(stage)        profiler::ScopedTimer PROFILE_CONCAT(profile_scope_, __LINE__)(profiler::stage)
+#define PROFILE_COUNT(counter, n)   profiler::Add(profiler::counter, (n))
+#define PROFILE_ONLY(...)           __VA_ARGS__
+
+#else
+
+#define PROFILE_INIT(path)          ((void)0)
+#define PROFILE_SCOPE(stage)        ((void)0)
+#define PROFILE_COUNT(counter, n)   ((void)0)
+#define PROFILE_ONLY(...)
+
+#endif
@@ -0,0 +1,936 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "rasterizer.h"
+#include "image.h"
+#include "profiler.h"
+#include "simd.h"
+
+template <class Format>
+static void draw_line(const Image<Format> &image, int x0, int y0, int x1, int y1, const TGAColor &color)
+{
+    typename Format::Pixel pixel = image.FromColor(color);
+    bool xy_swap = false;
+
+    if (std::abs(y1 - y0) > std::abs(x1 - x0))
+    {
+        xy_swap = true;
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+    }
+    if (x0 > x1)
+    {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+
+    int x_delta = x1 - x0;
+    int y_delta = 2 * std::abs(y1 - y0);
+    int y_error = 0;
+    int y_curr = y0;
+    for (int x_curr = x0; x_curr < x1; x_curr++)
+    {
+        if (xy_swap)
+        {
+            image.Set(y_curr, x_curr, pixel);
+        }
+        else
+        {
+            image.Set(x_curr, y_curr, pixel);
+        }
+
+        y_error += y_delta;
+        if (y_error > x_delta)
+        {
+            y_curr += (y1 > y0) ? 1 : -1;
+            y_error -= 2 * x_delta;
+        }
+    }
+}
+
+// Texel 'bgra', packed as Texture::Fetch packs it, with its colour channels
+// scaled by 'intensity' and its alpha kept.
+static inline std::uint32_t shade_texel(std::uint32_t bgra, float intensity)
+{
+    unsigned char b = (bgra & 0xff) * intensity;
+    unsigned char g = ((bgra >> 8) & 0xff) * intensity;
+    unsigned char r = ((bgra >> 16) & 0xff) * intensity;
+    return b | (g << 8) | (r << 16) | (bgra & 0xff000000);
+}
+
+// Mip level for the whole triangle from the ratio of its texel and screen
+// areas; 0 when the texture has no mipmaps.
+static float triangle_lod(const Texture &texture, const std::array<Vector3l, 3> &v,
+                          const std::array<Vector2l, 3> &u)
+{
+    if (texture.GetLevelsCount() < 2)
+    {
+        return 0.f;
+    }
+    float pixel_area = std::abs((float)((v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x)));
+    float texel_area = std::abs((float)((u[1].x - u[0].x) * (u[2].y - u[0].y) - (u[1].y - u[0].y) * (u[2].x - u[0].x)));
+    return texture.GetLod(texel_area, pixel_area);
+}
+
+template <class Format, class DepthFormat>
+static void scanline_triangle(const Image<Format> &image, std::array<Vector3l, 3> &v, std::array<Vector3f, 3> &n,
+                              std::array<Vector2l, 3> &u, const Depth<DepthFormat> &zbuffer, const Texture &texture,
+                              const Vector3f &light, const Rect &clip)
+{
+    if (v[0].y > v[1].y)
+    {
+        std::swap(v[0], v[1]);
+        std::swap(n[0], n[1]);
+        std::swap(u[0], u[1]);
+    }
+    if (v[0].y > v[2].y)
+    {
+        std::swap(v[0], v[2]);
+        std::swap(n[0], n[2]);
+        std::swap(u[0], u[2]);
+    }
+    if (v[1].y > v[2].y)
+    {
+        std::swap(v[1], v[2]);
+        std::swap(n[1], n[2]);
+        std::swap(u[1], u[2]);
+    }
+
+    if (v[0].y == v[2].y)
+    {
+        PROFILE_COUNT(TRIANGLES_DEGENERATE, 1);
+        return;
+    }
+
+    float lod = triangle_lod(texture, v, u);
+    float total_hight = v[2].y - v[0].y;
+    float low_sector_hight = v[1].y - v[0].y;
+    float high_sector_hight = v[2].y - v[1].y;
+
+    PROFILE_ONLY(unsigned long pixels_tested = 0, depth_passes = 0, texels_fetched = 0;)
+
+    long y_begin = std::max(v[0].y, clip.y0);
+    long y_end = std::min(v[2].y, clip.y1 - 1);
+    for (long y = y_begin; y <= y_end; y++)
+    {
+        Vector2l left_u = u[0] + (u[2] - u[0]) * ((y - v[0].y) / total_hight);
+        Vector3l left_v = v[0] + (v[2] - v[0]) * ((y - v[0].y) / total_hight);
+        Vector3f left_n = n[0] + (n[2] - n[0]) * ((y - v[0].y) / total_hight);
+        Vector2l right_u;
+        Vector3l right_v;
+        Vector3f right_n;
+
+        if (y <= v[1].y)
+        {
+            float ratio = (low_sector_hight == 0) ? 1 : (y - v[0].y) / low_sector_hight;
+            right_v = v[0] + (v[1] - v[0]) * ratio;
+            right_u = u[0] + (u[1] - u[0]) * ratio;
+            right_n = n[0] + (n[1] - n[0]) * ratio;
+        }
+        else
+        {
+            float ratio = (high_sector_hight == 0) ? 1 : (y - v[1].y) / high_sector_hight;
+            right_v = v[1] + (v[2] - v[1]) * ratio;
+            right_u = u[1] + (u[2] - u[1]) * ratio;
+            right_n = n[1] + (n[2] - n[1]) * ratio;
+        }
+
+        if (left_v.x > right_v.x)
+        {
+            std::swap(left_v, right_v);
+            std::swap(left_u, right_u);
+            std::swap(left_n, right_n);
+        }
+        long x_begin = std::max(left_v.x, clip.x0);
+        long x_end = std::min(right_v.x, clip.x1 - 1);
+        for (long x = x_begin; x <= x_end; x++)
+        {
+            float ratio = (right_v.x == left_v.x) ? 1 : ((float)(x - left_v.x) / (right_v.x - left_v.x));
+            long z = left_v.z + (right_v.z - left_v.z) * ratio;
+
+            PROFILE_ONLY(pixels_tested++;)
+            if (zbuffer.Get(x, y) < z)
+            {
+                PROFILE_ONLY(depth_passes++;)
+                Vector3f curr_n = left_n + (right_n - left_n) * ratio;
+                curr_n.normalize();
+                float intensity = curr_n * light;
+                if (intensity > 0)
+                {
+                    Vector2l curr_u = left_u + (right_u - left_u) * ratio;
+                    std::uint32_t texel = texture.FetchFiltered(curr_u.x, curr_u.y, lod);
+                    PROFILE_ONLY(texels_fetched++;)
+
+                    zbuffer.Set(x, y, z);
+                    image.SetUnchecked(x, y, Format::FromBgra(shade_texel(texel, intensity)));
+                }
+            }
+        }
+    }
+
+    PROFILE_COUNT(PIXELS_TESTED, pixels_tested);
+    PROFILE_COUNT(DEPTH_PASSES, depth_passes);
+    PROFILE_COUNT(TEXELS_FETCHED, texels_fetched);
+}
+
+namespace
+{
+
+struct EdgeFunction
+{
+    // E(p) = (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)
+    EdgeFunction(const Vector3l &a, const Vector3l &b, long x, long y)
+        : step_x(-(b.y - a.y)), step_y(b.x - a.x),
+          origin((b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x)) {};
+
+    // True when the rectangle [dx0, dx1] x [dy0, dy1], relative to the
+    // origin, lies on the negative side.
+    bool IsOutside(long dx0, long dx1, long dy0, long dy1) const
+    {
+        long c00 = origin + step_x * dx0 + step_y * dy0;
+        long c10 = origin + step_x * dx1 + step_y * dy0;
+        long c01 = origin + step_x * dx0 + step_y * dy1;
+        long c11 = origin + step_x * dx1 + step_y * dy1;
+        return c00 < 0 && c10 < 0 && c01 < 0 && c11 < 0;
+    }
+
+    long step_x;
+    long step_y;
+    long origin;
+};
+
+// Hierarchical z blocks of [min_x, max_x] x [min_y, max_y] that the
+// triangle with edges 'e' overlaps, the edges taken from (min_x, min_y).
+unsigned long count_blocks(const EdgeFunction (&e)[3], long min_x, long min_y, long max_x, long max_y)
+{
+    const long block_size = HierarchicalZ::BLOCK_SIZE;
+    unsigned long count = 0;
+    for (long by = min_y / block_size; by <= max_y / block_size; by++)
+    {
+        long dy0 = std::max(by * block_size, min_y) - min_y;
+        long dy1 = std::min(by * block_size + block_size - 1, max_y) - min_y;
+        for (long bx = min_x / block_size; bx <= max_x / block_size; bx++)
+        {
+            long dx0 = std::max(bx * block_size, min_x) - min_x;
+            long dx1 = std::min(bx * block_size + block_size - 1, max_x) - min_x;
+            count += !e[0].IsOutside(dx0, dx1, dy0, dy1) && !e[1].IsOutside(dx0, dx1, dy0, dy1) &&
+                     !e[2].IsOutside(dx0, dx1, dy0, dy1);
+        }
+    }
+    return count;
+}
+
+}
+
+template <class Format, class DepthFormat>
+static bool edge_triangle(const Image<Format> &image, const ScreenTriangle &t, const Depth<DepthFormat> &zbuffer,
+                          const Texture &texture, const Vector3f &light, const Rect &clip, HierarchicalZ *hiz)
+{
+    using namespace simd;
+
+    std::array<Vector3l, 3> v = t.v;
+    std::array<Vector3f, 3> n = t.n;
+    std::array<Vector2l, 3> u = t.u;
+
+    long area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+    if (area == 0)
+    {
+        PROFILE_COUNT(TRIANGLES_DEGENERATE, 1);
+        return false;
+    }
+    if (area < 0)
+    {
+        std::swap(v[1], v[2]);
+        std::swap(n[1], n[2]);
+        std::swap(u[1], u[2]);
+        area = -area;
+    }
+    float lod = triangle_lod(texture, v, u);
+
+    long min_x = std::max(std::min(v[0].x, std::min(v[1].x, v[2].x)), clip.x0);
+    long max_x = std::min(std::max(v[0].x, std::max(v[1].x, v[2].x)), clip.x1 - 1);
+    long min_y = std::max(std::min(v[0].y, std::min(v[1].y, v[2].y)), clip.y0);
+    long max_y = std::min(std::max(v[0].y, std::max(v[1].y, v[2].y)), clip.y1 - 1);
+    if (min_x > max_x || min_y > max_y)
+    {
+        return false;
+    }
+
+    long z_min = std::min(v[0].z, std::min(v[1].z, v[2].z));
+    long z_max = std::max(v[0].z, std::max(v[1].z, v[2].z));
+    EdgeFunction e0(v[1], v[2], min_x, min_y);
+    EdgeFunction e1(v[2], v[0], min_x, min_y);
+    EdgeFunction e2(v[0], v[1], min_x, min_y);
+    if (hiz && hiz->IsRectOccluded(min_x, min_y, max_x, max_y, z_max))
+    {
+        // the blocks count as culled one by one, as they would be had only
+        // part of the triangle been rejected, so that the count does not
+        // depend on how the screen is split into tiles
+        const EdgeFunction edges[3] = {e0, e1, e2};
+        hiz->AddCulled(0, count_blocks(edges, min_x, min_y, max_x, max_y));
+        return true;
+    }
+
+    // Per-lane edge offsets within a packet and the per-packet increments.
+    IntPack lane = LaneIndex();
+    IntPack lane_e0, lane_e1, lane_e2;
+    {
+        int offsets[3][WIDTH];
+        for (int k = 0; k < WIDTH; k++)
+        {
+            offsets[0][k] = (int)(e0.step_x * k);
+            offsets[1][k] = (int)(e1.step_x * k);
+            offsets[2][k] = (int)(e2.step_x * k);
+        }
+        lane_e0 = Load(offsets[0]);
+        lane_e1 = Load(offsets[1]);
+        lane_e2 = Load(offsets[2]);
+    }
+    IntPack packet_e0 = Set1((int)(e0.step_x * WIDTH));
+    IntPack packet_e1 = Set1((int)(e1.step_x * WIDTH));
+    IntPack packet_e2 = Set1((int)(e2.step_x * WIDTH));
+
+    // Attributes are interpolated as a0 + w1 * (a1 - a0) + w2 * (a2 - a0).
+    FloatPack inv_area = Set1(1.f / area);
+    FloatPack z0 = Set1((float)v[0].z), dz1 = Set1((float)(v[1].z - v[0].z)), dz2 = Set1((float)(v[2].z - v[0].z));
+    FloatPack nx0 = Set1(n[0].x), dnx1 = Set1(n[1].x - n[0].x), dnx2 = Set1(n[2].x - n[0].x);
+    FloatPack ny0 = Set1(n[0].y), dny1 = Set1(n[1].y - n[0].y), dny2 = Set1(n[2].y - n[0].y);
+    FloatPack nz0 = Set1(n[0].z), dnz1 = Set1(n[1].z - n[0].z), dnz2 = Set1(n[2].z - n[0].z);
+    FloatPack ux0 = Set1((float)u[0].x), dux1 = Set1((float)(u[1].x - u[0].x)), dux2 = Set1((float)(u[2].x - u[0].x));
+    FloatPack uy0 = Set1((float)u[0].y), duy1 = Set1((float)(u[1].y - u[0].y)), duy2 = Set1((float)(u[2].y - u[0].y));
+    FloatPack lx = Set1(light.x), ly = Set1(light.y), lz = Set1(light.z);
+
+    const long block_size = HierarchicalZ::BLOCK_SIZE;
+
+    alignas(32) int z_lanes[WIDTH];
+    alignas(32) int ux_lanes[WIDTH];
+    alignas(32) int uy_lanes[WIDTH];
+    alignas(32) float intensity_lanes[WIDTH];
+
+    unsigned long culled_blocks = 0;
+    PROFILE_ONLY(unsigned long pixels_tested = 0, depth_passes = 0, texels_fetched = 0;)
+
+    // The bounding box is walked in block_size x block_size blocks so that
+    // blocks outside the triangle or behind the z-buffer are skipped whole.
+    for (long by = min_y / block_size; by <= max_y / block_size; by++)
+    {
+        long y_begin = std::max(by * block_size, min_y);
+        long y_end = std::min(by * block_size + block_size - 1, max_y);
+        for (long bx = min_x / block_size; bx <= max_x / block_size; bx++)
+        {
+            long x_begin = std::max(bx * block_size, min_x);
+            long x_end = std::min(bx * block_size + block_size - 1, max_x);
+
+            long dx0 = x_begin - min_x, dx1 = x_end - min_x;
+            long dy0 = y_begin - min_y, dy1 = y_end - min_y;
+            if (e0.IsOutside(dx0, dx1, dy0, dy1) || e1.IsOutside(dx0, dx1, dy0, dy1) ||
+                e2.IsOutside(dx0, dx1, dy0, dy1))
+            {
+                continue;
+            }
+
+            bool depth_pass = false;
+            if (hiz)
+            {
+                if (hiz->IsOccluded(bx, by, z_max))
+                {
+                    culled_blocks++;
+                    continue;
+                }
+                depth_pass = hiz->IsVisible(bx, by, z_min);
+            }
+
+            IntPack last_x = Set1((int)x_end);
+            bool written = false;
+            for (long y = y_begin; y <= y_end; y++)
+            {
+                long dy = y - min_y;
+                IntPack w0 = Set1((int)(e0.origin + e0.step_x * dx0 + e0.step_y * dy)) + lane_e0;
+                IntPack w1 = Set1((int)(e1.origin + e1.step_x * dx0 + e1.step_y * dy)) + lane_e1;
+                IntPack w2 = Set1((int)(e2.origin + e2.step_x * dx0 + e2.step_y * dy)) + lane_e2;
+                IntPack xs = Set1((int)x_begin) + lane;
+
+                for (long x = x_begin; x <= x_end; x += WIDTH)
+                {
+                    int mask = ~(SignMask(w0 | w1 | w2) | SignMask(CmpGt(xs, last_x))) & ((1 << WIDTH) - 1);
+                    if (mask)
+                    {
+                        FloatPack b1 = ToFloat(w1) * inv_area;
+                        FloatPack b2 = ToFloat(w2) * inv_area;
+
+                        FloatPack nx = nx0 + b1 * dnx1 + b2 * dnx2;
+                        FloatPack ny = ny0 + b1 * dny1 + b2 * dny2;
+                        FloatPack nz = nz0 + b1 * dnz1 + b2 * dnz2;
+                        FloatPack len = Sqrt(nx * nx + ny * ny + nz * nz);
+
+                        Store(z_lanes, Truncate(z0 + b1 * dz1 + b2 * dz2));
+                        Store(intensity_lanes, (nx * lx + ny * ly + nz * lz) / len);
+                        Store(ux_lanes, Truncate(ux0 + b1 * dux1 + b2 * dux2));
+                        Store(uy_lanes, Truncate(uy0 + b1 * duy1 + b2 * duy2));
+
+                        for (int k = 0; k < WIDTH; k++)
+                        {
+                            if (!(mask & (1 << k)))
+                            {
+                                continue;
+                            }
+                            float intensity = intensity_lanes[k];
+                            bool depth_ok = depth_pass || zbuffer.Get(x + k, y) < z_lanes[k];
+                            PROFILE_ONLY(pixels_tested++; depth_passes += depth_ok;)
+                            if (depth_ok && intensity > 0)
+                            {
+                                std::uint32_t texel = texture.FetchFiltered(ux_lanes[k], uy_lanes[k], lod);
+                                PROFILE_ONLY(texels_fetched++;)
+
+                                zbuffer.Set(x + k, y, z_lanes[k]);
+                                image.SetUnchecked(x + k, y, Format::FromBgra(shade_texel(texel, intensity)));
+                                written = true;
+                            }
+                        }
+                    }
+
+                    w0 = w0 + packet_e0;
+                    w1 = w1 + packet_e1;
+                    w2 = w2 + packet_e2;
+                    xs = xs + Set1(WIDTH);
+                }
+            }
+
+            if (hiz && written)
+            {
+                hiz->UpdateBlock(bx, by, zbuffer);
+            }
+        }
+    }
+
+    if (hiz)
+    {
+        hiz->AddCulled(0, culled_blocks);
+    }
+    PROFILE_COUNT(PIXELS_TESTED, pixels_tested);
+    PROFILE_COUNT(DEPTH_PASSES, depth_passes);
+    PROFILE_COUNT(TEXELS_FETCHED, texels_fetched);
+    return false;
+}
+
+namespace
+{
+
+// Fractional bits of the attributes stepped by the fixed-point rasterizer,
+// and the scale normals and the light direction are quantized to.
+const int ATTRIBUTE_BITS = 16;
+const long ATTRIBUTE_ONE = 1L << ATTRIBUTE_BITS;
+const long NORMAL_SCALE = 1024;
+
+// Rounding towards -infinity, for b > 0.
+inline long floor_div(long a, long b)
+{
+    return a >= 0 ? a / b : -((b - 1 - a) / b);
+}
+
+inline long quantize(float f)
+{
+    return std::lround(f * NORMAL_SCALE);
+}
+
+struct FixedEdge
+{
+    // E(p) = (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x) at the
+    // centre of pixel (x, y), in subpixel units. Centres exactly on an edge
+    // belong to the triangle only if the edge is a top or a left one, which
+    // 'bias' encodes as E + bias >= 0.
+    FixedEdge(const Vector2l &a, const Vector2l &b, long x, long y)
+        : step_x(-(b.y - a.y) * SUBPIXEL_SCALE), step_y((b.x - a.x) * SUBPIXEL_SCALE),
+          origin((b.x - a.x) * (y * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2 - a.y) -
+                 (b.y - a.y) * (x * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2 - a.x)),
+          bias((b.y < a.y || (b.y == a.y && b.x > a.x)) ? 0 : -1) {};
+
+    long step_x;
+    long step_y;
+    long origin;
+    long bias;
+};
+
+// a0 + (w1 * (a1 - a0) + w2 * (a2 - a0)) / area in ATTRIBUTE_BITS fixed
+// point, with w1 and w2 the edge values opposite to vertex 1 and 2. The
+// value is exact at the edges' origin and stepped from there.
+struct FixedAttribute : AttributePlane
+{
+    FixedAttribute(long a0, long a1, long a2, const FixedEdge &e1, const FixedEdge &e2, long area)
+    {
+        origin = a0 * ATTRIBUTE_ONE + (e1.origin * (a1 - a0) + e2.origin * (a2 - a0)) * ATTRIBUTE_ONE / area;
+        step_x = (e1.step_x * (a1 - a0) + e2.step_x * (a2 - a0)) * ATTRIBUTE_ONE / area;
+        step_y = (e1.step_y * (a1 - a0) + e2.step_y * (a2 - a0)) * ATTRIBUTE_ONE / area;
+    }
+};
+
+// Doubled area of 't' in subpixel units, after swapping two corners of a
+// clockwise triangle so that it is positive. 0 for a degenerate triangle.
+long orient_fixed(ScreenTriangle &t)
+{
+    const std::array<Vector2l, 3> &p = t.p;
+    long area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+    if (area < 0)
+    {
+        std::swap(t.p[1], t.p[2]);
+        std::swap(t.v[1], t.v[2]);
+        std::swap(t.n[1], t.n[2]);
+        std::swap(t.u[1], t.u[2]);
+        area = -area;
+    }
+    return area;
+}
+
+// Edges and attribute planes of an oriented, non-degenerate triangle. Every
+// value derives from the unclipped bounds, so any pixel gets the same
+// attributes whichever rectangle or pass it is drawn in.
+struct FixedSetup
+{
+    FixedSetup(const ScreenTriangle &t, long area, const Rect &_bounds)
+        : bounds(_bounds),
+          edges{FixedEdge(t.p[1], t.p[2], bounds.x0, bounds.y0),
+                FixedEdge(t.p[2], t.p[0], bounds.x0, bounds.y0),
+                FixedEdge(t.p[0], t.p[1], bounds.x0, bounds.y0)},
+          z(t.v[0].z, t.v[1].z, t.v[2].z, edges[1], edges[2], area),
+          ux(t.u[0].x, t.u[1].x, t.u[2].x, edges[1], edges[2], area),
+          uy(t.u[0].y, t.u[1].y, t.u[2].y, edges[1], edges[2], area),
+          nx(quantize(t.n[0].x), quantize(t.n[1].x), quantize(t.n[2].x), edges[1], edges[2], area),
+          ny(quantize(t.n[0].y), quantize(t.n[1].y), quantize(t.n[2].y), edges[1], edges[2], area),
+          nz(quantize(t.n[0].z), quantize(t.n[1].z), quantize(t.n[2].z), edges[1], edges[2], area) {};
+
+    // Narrows [x_begin, x_end] to the pixels of row 'y' the triangle covers.
+    // The span is solved for directly, so the pixel loops need no inside test.
+    void ClipSpan(long y, long &x_begin, long &x_end) const
+    {
+        long dy = y - bounds.y0;
+        for (const FixedEdge &e : edges)
+        {
+            long c = e.origin + e.bias + e.step_y * dy;
+            if (e.step_x > 0)
+            {
+                x_begin = std::max(x_begin, bounds.x0 - floor_div(c, e.step_x));
+            }
+            else if (e.step_x < 0)
+            {
+                x_end = std::min(x_end, bounds.x0 + floor_div(c, -e.step_x));
+            }
+            else if (c < 0)
+            {
+                x_end = x_begin - 1;
+            }
+        }
+    }
+
+    Rect bounds;
+    FixedEdge edges[3];
+    FixedAttribute z;
+    FixedAttribute ux;
+    FixedAttribute uy;
+    FixedAttribute nx;
+    FixedAttribute ny;
+    FixedAttribute nz;
+};
+
+struct FixedLight
+{
+    explicit FixedLight(const Vector3f &light) : x(quantize(light.x)), y(quantize(light.y)), z(quantize(light.z)) {};
+
+    long Dot(long nx, long ny, long nz) const { return nx * x + ny * y + nz * z; }
+
+    long x;
+    long y;
+    long z;
+};
+
+// Colour of a fragment with integer normal (nx, ny, nz) and 'dot' > 0 its
+// dot product with the light, packed as Texture::Fetch packs texels.
+inline std::uint32_t shade_fixed(const Texture &texture, long ux, long uy, float lod, long nx, long ny, long nz,
+                                 long dot)
+{
+    // the operands are exact in a float and sqrt and division are correctly
+    // rounded, so this is the same on every IEEE platform
+    float len = std::sqrt((float)(nx * nx + ny * ny + nz * nz)) * NORMAL_SCALE;
+    std::uint32_t shade = std::min((long)(dot * 256.f / len), 256L);
+    std::uint32_t texel = texture.FetchFiltered(ux, uy, lod);
+    std::uint32_t b = ((texel & 0xff) * shade) >> 8;
+    std::uint32_t g = (((texel >> 8) & 0xff) * shade) >> 8;
+    std::uint32_t r = (((texel >> 16) & 0xff) * shade) >> 8;
+    return b | (g << 8) | (r << 16) | (texel & 0xff000000);
+}
+
+}
+
+template <class Format, class DepthFormat>
+static void fixed_triangle(const Image<Format> &image, const ScreenTriangle &t, const Depth<DepthFormat> &zbuffer,
+                           const Texture &texture, const Vector3f &light, const Rect &clip)
+{
+    ScreenTriangle oriented = t;
+    long area = orient_fixed(oriented);
+    if (area == 0)
+    {
+        PROFILE_COUNT(TRIANGLES_DEGENERATE, 1);
+        return;
+    }
+
+    // the clip rectangle only selects which pixels get visited
+    Rect bounds = get_bounds(oriented, RASTER_FIXED);
+    long min_x = std::max(bounds.x0, clip.x0);
+    long max_x = std::min(bounds.x1, clip.x1) - 1;
+    long min_y = std::max(bounds.y0, clip.y0);
+    long max_y = std::min(bounds.y1, clip.y1) - 1;
+    if (min_x > max_x || min_y > max_y)
+    {
+        return;
+    }
+    float lod = triangle_lod(texture, oriented.v, oriented.u);
+    const FixedSetup s(oriented, area, bounds);
+    const FixedLight l(light);
+
+    PROFILE_ONLY(unsigned long pixels_tested = 0, depth_passes = 0, texels_fetched = 0;)
+
+    for (long y = min_y; y <= max_y; y++)
+    {
+        long x_begin = min_x, x_end = max_x;
+        s.ClipSpan(y, x_begin, x_end);
+
+        long dx = x_begin - bounds.x0, dy = y - bounds.y0;
+        long z_curr = s.z.At(dx, dy);
+        long ux_curr = s.ux.At(dx, dy);
+        long uy_curr = s.uy.At(dx, dy);
+        long nx_curr = s.nx.At(dx, dy);
+        long ny_curr = s.ny.At(dx, dy);
+        long nz_curr = s.nz.At(dx, dy);
+
+        for (long x = x_begin; x <= x_end; x++)
+        {
+            long depth = z_curr >> ATTRIBUTE_BITS;
+            PROFILE_ONLY(pixels_tested++;)
+            if (zbuffer.Get(x, y) < depth)
+            {
+                PROFILE_ONLY(depth_passes++;)
+                long nxi = nx_curr >> ATTRIBUTE_BITS, nyi = ny_curr >> ATTRIBUTE_BITS, nzi = nz_curr >> ATTRIBUTE_BITS;
+                long dot = l.Dot(nxi, nyi, nzi);
+                if (dot > 0)
+                {
+                    PROFILE_ONLY(texels_fetched++;)
+                    zbuffer.Set(x, y, depth);
+                    image.SetUnchecked(x, y, Format::FromBgra(shade_fixed(texture, ux_curr >> ATTRIBUTE_BITS,
+                                                                          uy_curr >> ATTRIBUTE_BITS, lod, nxi, nyi,
+                                                                          nzi, dot)));
+                }
+            }
+
+            z_curr += s.z.step_x;
+            ux_curr += s.ux.step_x;
+            uy_curr += s.uy.step_x;
+            nx_curr += s.nx.step_x;
+            ny_curr += s.ny.step_x;
+            nz_curr += s.nz.step_x;
+        }
+    }
+
+    PROFILE_COUNT(PIXELS_TESTED, pixels_tested);
+    PROFILE_COUNT(DEPTH_PASSES, depth_passes);
+    PROFILE_COUNT(TEXELS_FETCHED, texels_fetched);
+}
+
+// Depth pass of the fixed-point rasterizer: the same coverage, depth and
+// lighting test as fixed_triangle(), but a passing fragment only records 'id'.
+template <class DepthFormat>
+static void visibility_triangle(const ScreenTriangle &t, std::uint32_t id, const Depth<DepthFormat> &zbuffer,
+                                VisibilityBuffer &visibility, const Vector3f &light, const Rect &clip)
+{
+    ScreenTriangle oriented = t;
+    long area = orient_fixed(oriented);
+    if (area == 0)
+    {
+        PROFILE_COUNT(TRIANGLES_DEGENERATE, 1);
+        return;
+    }
+
+    Rect bounds = get_bounds(oriented, RASTER_FIXED);
+    long min_x = std::max(bounds.x0, clip.x0);
+    long max_x = std::min(bounds.x1, clip.x1) - 1;
+    long min_y = std::max(bounds.y0, clip.y0);
+    long max_y = std::min(bounds.y1, clip.y1) - 1;
+    if (min_x > max_x || min_y > max_y)
+    {
+        return;
+    }
+    const FixedSetup s(oriented, area, bounds);
+    const FixedLight l(light);
+
+    PROFILE_ONLY(unsigned long pixels_tested = 0, depth_passes = 0;)
+
+    for (long y = min_y; y <= max_y; y++)
+    {
+        long x_begin = min_x, x_end = max_x;
+        s.ClipSpan(y, x_begin, x_end);
+
+        long dx = x_begin - bounds.x0, dy = y - bounds.y0;
+        long z_curr = s.z.At(dx, dy);
+        long nx_curr = s.nx.At(dx, dy);
+        long ny_curr = s.ny.At(dx, dy);
+        long nz_curr = s.nz.At(dx, dy);
+
+        for (long x = x_begin; x <= x_end; x++)
+        {
+            long depth = z_curr >> ATTRIBUTE_BITS;
+            PROFILE_ONLY(pixels_tested++;)
+            if (zbuffer.Get(x, y) < depth &&
+                l.Dot(nx_curr >> ATTRIBUTE_BITS, ny_curr >> ATTRIBUTE_BITS, nz_curr >> ATTRIBUTE_BITS) > 0)
+            {
+                PROFILE_ONLY(depth_passes++;)
+                zbuffer.Set(x, y, depth);
+                visibility.Set(x, y, id);
+            }
+
+            z_curr += s.z.step_x;
+            nx_curr += s.nx.step_x;
+            ny_curr += s.ny.step_x;
+            nz_curr += s.nz.step_x;
+        }
+    }
+
+    PROFILE_COUNT(PIXELS_TESTED, pixels_tested);
+    PROFILE_COUNT(DEPTH_PASSES, depth_passes);
+}
+
+template <class Format>
+static void shade_pixels(const Image<Format> &image, const VisibilityBuffer &visibility,
+                         const std::vector<ShadingSetup> &setups, const Vector3f &light, const Rect &clip)
+{
+    const FixedLight l(light);
+    PROFILE_ONLY(unsigned long texels_fetched = 0;)
+    for (long y = clip.y0; y < clip.y1; y++)
+    {
+        long x = clip.x0;
+        while (x < clip.x1)
+        {
+            std::uint32_t id = visibility.Get(x, y);
+            if (id == VisibilityBuffer::EMPTY)
+            {
+                x++;
+                continue;
+            }
+
+            // neighbouring pixels mostly show the same triangle: its
+            // attributes are evaluated once per run and stepped from there
+            const ShadingSetup &s = setups[id];
+            long dx = x - s.x0, dy = y - s.y0;
+            long ux_curr = s.ux.At(dx, dy);
+            long uy_curr = s.uy.At(dx, dy);
+            long nx_curr = s.nx.At(dx, dy);
+            long ny_curr = s.ny.At(dx, dy);
+            long nz_curr = s.nz.At(dx, dy);
+            do
+            {
+                long nxi = nx_curr >> ATTRIBUTE_BITS, nyi = ny_curr >> ATTRIBUTE_BITS, nzi = nz_curr >> ATTRIBUTE_BITS;
+                PROFILE_ONLY(texels_fetched++;)
+                image.SetUnchecked(x, y, Format::FromBgra(shade_fixed(*s.texture, ux_curr >> ATTRIBUTE_BITS,
+                                                                      uy_curr >> ATTRIBUTE_BITS, s.lod, nxi, nyi,
+                                                                      nzi, l.Dot(nxi, nyi, nzi))));
+                ux_curr += s.ux.step_x;
+                uy_curr += s.uy.step_x;
+                nx_curr += s.nx.step_x;
+                ny_curr += s.ny.step_x;
+                nz_curr += s.nz.step_x;
+                x++;
+            } while (x < clip.x1 && visibility.Get(x, y) == id);
+        }
+    }
+    PROFILE_COUNT(TEXELS_FETCHED, texels_fetched);
+}
+
+Rect get_bounds(const ScreenTriangle &t, RasterMode mode)
+{
+    if (mode == RASTER_FIXED)
+    {
+        const std::array<Vector2l, 3> &p = t.p;
+        if ((p[1].x - p[0].x) * (p[2].y - p[0].y) == (p[1].y - p[0].y) * (p[2].x - p[0].x))
+        {
+            return Rect();
+        }
+        // a pixel centre x + 1/2 inside [min, max] has floor(min) <= x <= floor(max)
+        return Rect(floor_div(std::min(p[0].x, std::min(p[1].x, p[2].x)), SUBPIXEL_SCALE),
+                    floor_div(std::min(p[0].y, std::min(p[1].y, p[2].y)), SUBPIXEL_SCALE),
+                    floor_div(std::max(p[0].x, std::max(p[1].x, p[2].x)), SUBPIXEL_SCALE) + 1,
+                    floor_div(std::max(p[0].y, std::max(p[1].y, p[2].y)), SUBPIXEL_SCALE) + 1);
+    }
+    const std::array<Vector3l, 3> &v = t.v;
+    long min_y = std::min(v[0].y, std::min(v[1].y, v[2].y));
+    long max_y = std::max(v[0].y, std::max(v[1].y, v[2].y));
+    if (min_y == max_y)
+    {
+        return Rect();
+    }
+    return Rect(std::min(v[0].x, std::min(v[1].x, v[2].x)), min_y,
+                std::max(v[0].x, std::max(v[1].x, v[2].x)) + 1, max_y + 1);
+}
+
+// The pixel format is resolved once per call here rather than once per
+// pixel in TGAImage::set.
+void line(TGAImage &image, int x0, int y0, int x1, int y1, TGAColor color)
+{
+    switch (image.get_bytespp())
+    {
+        case TGAImage::GRAYSCALE: draw_line(Image<Gray8>(image.view()), x0, y0, x1, y1, color); break;
+        case TGAImage::RGB:       draw_line(Image<RGB8>(image.view()), x0, y0, x1, y1, color); break;
+        case TGAImage::RGBA:      draw_line(Image<RGBA8>(image.view()), x0, y0, x1, y1, color); break;
+    }
+}
+
+// The depth format is resolved once per triangle here, as the image format
+// is in the public functions below.
+template <class Format>
+static void scanline_triangle(const Image<Format> &image, std::array<Vector3l, 3> &v, std::array<Vector3f, 3> &n,
+                              std::array<Vector2l, 3> &u, DepthBuffer &zbuffer, const Texture &texture,
+                              const Vector3f &light, const Rect &clip)
+{
+    switch (zbuffer.GetFormat())
+    {
+        case DepthBuffer::DEPTH16:  scanline_triangle(image, v, n, u, Depth<Depth16>(zbuffer), texture, light, clip); break;
+        case DepthBuffer::DEPTH24:  scanline_triangle(image, v, n, u, Depth<Depth24>(zbuffer), texture, light, clip); break;
+        case DepthBuffer::DEPTH32F: scanline_triangle(image, v, n, u, Depth<Depth32F>(zbuffer), texture, light, clip); break;
+    }
+}
+
+template <class Format>
+static bool edge_triangle(const Image<Format> &image, const ScreenTriangle &t, DepthBuffer &zbuffer,
+                          const Texture &texture, const Vector3f &light, const Rect &clip, HierarchicalZ *hiz)
+{
+    switch (zbuffer.GetFormat())
+    {
+        case DepthBuffer::DEPTH16:  return edge_triangle(image, t, Depth<Depth16>(zbuffer), texture, light, clip, hiz);
+        case DepthBuffer::DEPTH24:  return edge_triangle(image, t, Depth<Depth24>(zbuffer), texture, light, clip, hiz);
+        case DepthBuffer::DEPTH32F: return edge_triangle(image, t, Depth<Depth32F>(zbuffer), texture, light, clip, hiz);
+    }
+    return false;
+}
+
+template <class Format>
+static void fixed_triangle(const Image<Format> &image, const ScreenTriangle &t, DepthBuffer &zbuffer,
+                           const Texture &texture, const Vector3f &light, const Rect &clip)
+{
+    switch (zbuffer.GetFormat())
+    {
+        case DepthBuffer::DEPTH16:  fixed_triangle(image, t, Depth<Depth16>(zbuffer), texture, light, clip); break;
+        case DepthBuffer::DEPTH24:  fixed_triangle(image, t, Depth<Depth24>(zbuffer), texture, light, clip); break;
+        case DepthBuffer::DEPTH32F: fixed_triangle(image, t, Depth<Depth32F>(zbuffer), texture, light, clip); break;
+    }
+}
+
+// Restricts 'clip' to the image, so that the triangle loops may store
+// pixels unchecked.
+static Rect clip_to_image(TGAImage &image, const Rect &clip)
+{
+    return Rect(std::max(clip.x0, 0L), std::max(clip.y0, 0L),
+                std::min(clip.x1, (long)image.get_width()), std::min(clip.y1, (long)image.get_height()));
+}
+
+void triangle(TGAImage &image, std::array<Vector3l, 3> &v, std::array<Vector3f, 3> &n,
+              std::array<Vector2l, 3> &u, DepthBuffer &zbuffer, const Texture &texture, Vector3f &light,
+              const Rect &clip)
+{
+    Rect rect = clip_to_image(image, clip);
+    switch (image.get_bytespp())
+    {
+        case TGAImage::GRAYSCALE: scanline_triangle(Image<Gray8>(image.view()), v, n, u, zbuffer, texture, light, rect); break;
+        case TGAImage::RGB:       scanline_triangle(Image<RGB8>(image.view()), v, n, u, zbuffer, texture, light, rect); break;
+        case TGAImage::RGBA:      scanline_triangle(Image<RGBA8>(image.view()), v, n, u, zbuffer, texture, light, rect); break;
+    }
+}
+
+bool triangle_edge(TGAImage &image, const ScreenTriangle &t, DepthBuffer &zbuffer, const Texture &texture,
+                   const Vector3f &light, const Rect &clip, HierarchicalZ *hiz)
+{
+    Rect rect = clip_to_image(image, clip);
+    switch (image.get_bytespp())
+    {
+        case TGAImage::GRAYSCALE: return edge_triangle(Image<Gray8>(image.view()), t, zbuffer, texture, light, rect, hiz);
+        case TGAImage::RGB:       return edge_triangle(Image<RGB8>(image.view()), t, zbuffer, texture, light, rect, hiz);
+        case TGAImage::RGBA:      return edge_triangle(Image<RGBA8>(image.view()), t, zbuffer, texture, light, rect, hiz);
+    }
+    return false;
+}
+
+void triangle_fixed(TGAImage &image, const ScreenTriangle &t, DepthBuffer &zbuffer, const Texture &texture,
+                    const Vector3f &light, const Rect &clip)
+{
+    Rect rect = clip_to_image(image, clip);
+    switch (image.get_bytespp())
+    {
+        case TGAImage::GRAYSCALE: fixed_triangle(Image<Gray8>(image.view()), t, zbuffer, texture, light, rect); break;
+        case TGAImage::RGB:       fixed_triangle(Image<RGB8>(image.view()), t, zbuffer, texture, light, rect); break;
+        case TGAImage::RGBA:      fixed_triangle(Image<RGBA8>(image.view()), t, zbuffer, texture, light, rect); break;
+    }
+}
+
+ShadingSetup setup_shading(const ScreenTriangle &t, const Texture &texture)
+{
+    ShadingSetup setup = ShadingSetup();
+    ScreenTriangle oriented = t;
+    long area = orient_fixed(oriented);
+    if (area == 0)
+    {
+        // never referenced: the depth pass draws nothing for it
+        return setup;
+    }
+    Rect bounds = get_bounds(oriented, RASTER_FIXED);
+    const FixedSetup s(oriented, area, bounds);
+    setup.x0 = bounds.x0;
+    setup.y0 = bounds.y0;
+    setup.ux = s.ux;
+    setup.uy = s.uy;
+    setup.nx = s.nx;
+    setup.ny = s.ny;
+    setup.nz = s.nz;
+    setup.texture = &texture;
+    setup.lod = triangle_lod(texture, oriented.v, oriented.u);
+    return setup;
+}
+
+void triangle_visibility(const ScreenTriangle &t, std::uint32_t id, DepthBuffer &zbuffer,
+                         VisibilityBuffer &visibility, const Vector3f &light, const Rect &clip)
+{
+    Rect rect(std::max(clip.x0, 0L), std::max(clip.y0, 0L),
+              std::min(clip.x1, visibility.GetWidth()), std::min(clip.y1, visibility.GetHeight()));
+    switch (zbuffer.GetFormat())
+    {
+        case DepthBuffer::DEPTH16:  visibility_triangle(t, id, Depth<Depth16>(zbuffer), visibility, light, rect); break;
+        case DepthBuffer::DEPTH24:  visibility_triangle(t, id, Depth<Depth24>(zbuffer), visibility, light, rect); break;
+        case DepthBuffer::DEPTH32F: visibility_triangle(t, id, Depth<Depth32F>(zbuffer), visibility, light, rect); break;
+    }
+}
+
+void shade_visibility(TGAImage &image, const VisibilityBuffer &visibility, const std::vector<ShadingSetup> &setups,
+                      const Vector3f &light, const Rect &clip)
+{
+    Rect rect = clip_to_image(image, clip);
+    rect.x1 = std::min(rect.x1, visibility.GetWidth());
+    rect.y1 = std::min(rect.y1, visibility.GetHeight());
+    switch (image.get_bytespp())
+    {
+        case TGAImage::GRAYSCALE: shade_pixels(Image<Gray8>(image.view()), visibility, setups, light, rect); break;
+        case TGAImage::RGB:       shade_pixels(Image<RGB8>(image.view()), visibility, setups, light, rect); break;
+        case TGAImage::RGBA:      shade_pixels(Image<RGBA8>(image.view()), visibility, setups, light, rect); break;
+    }
+}
+
+bool rasterize(RasterMode mode, TGAImage &image, const ScreenTriangle &t, DepthBuffer &zbuffer,
+               const Texture &texture, Vector3f &light, const Rect &clip, HierarchicalZ *hiz)
+{
+    if (mode == RASTER_EDGE)
+    {
+        return triangle_edge(image, t, zbuffer, texture, light, clip, hiz);
+    }
+    if (mode == RASTER_FIXED)
+    {
+        triangle_fixed(image, t, zbuffer, texture, light, clip);
+        return false;
+    }
+    ScreenTriangle copy = t;
+    triangle(image, copy.v, copy.n, copy.u, zbuffer, texture, light, clip);
+    return false;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "texture.h"
+#include "hiz_buffer.h"
+#include "depth_buffer.h"
+#include "visibility_buffer.h"
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1) the rasterizer may write to.
+struct Rect
+{
+    Rect() : x0(0), y0(0), x1(0), y1(0) {};
+    Rect(long _x0, long _y0, long _x1, long _y1) : x0(_x0), y0(_y0), x1(_x1), y1(_y1) {};
+
+    bool Empty() const { return x0 >= x1 || y0 >= y1; }
+
+    long x0;
+    long y0;
+    long x1;
+    long y1;
+};
+
+enum RasterMode
+{
+    RASTER_SCANLINE,
+    RASTER_EDGE,
+    RASTER_FIXED
+};
+
+// Fractional bits of the fixed-point screen positions in ScreenTriangle::p.
+const int SUBPIXEL_BITS = 4;
+const long SUBPIXEL_SCALE = 1L << SUBPIXEL_BITS;
+
+// Screen-space triangle ready for rasterization. 'v' holds the positions
+// rounded to whole pixels, 'p' the same x and y in 1/SUBPIXEL_SCALE pixels.
+struct ScreenTriangle
+{
+    std::array<Vector3l, 3> v;
+    std::array<Vector2l, 3> p;
+    std::array<Vector3f, 3> n;
+    std::array<Vector2l, 3> u;
+};
+
+// Pixels whose centres a triangle may cover in 'mode', not clipped to any
+// screen; empty when the triangle has no area.
+Rect get_bounds(const ScreenTriangle &t, RasterMode mode);
+
+void line(TGAImage &image, int x0, int y0, int x1, int y1, TGAColor color);
+
+// Scanline rasterizer. Only pixels inside 'clip' are touched, so callers that
+// split the screen into disjoint rectangles may run concurrently.
+void triangle(TGAImage &image, std::array<Vector3l, 3> &v, std::array<Vector3f, 3> &n,
+              std::array<Vector2l, 3> &u, DepthBuffer &zbuffer, const Texture &texture, Vector3f &light,
+              const Rect &clip);
+
+// Half-space rasterizer: evaluates the edge functions incrementally for a
+// packet of simd::WIDTH pixels per step and shades the packet at once.
+// When 'hiz' is given, occluded triangles and blocks are rejected before any
+// per-pixel work and 'hiz' is kept up to date with the z-buffer. Returns true
+// when the part of 't' inside 'clip' was rejected whole; culled blocks are
+// counted in 'hiz', the triangle is left to the caller, which knows whether
+// 't' was split between several clip rectangles.
+bool triangle_edge(TGAImage &image, const ScreenTriangle &t, DepthBuffer &zbuffer, const Texture &texture,
+                   const Vector3f &light, const Rect &clip, HierarchicalZ *hiz = nullptr);
+
+// Fixed-point rasterizer working on 't.p': pixel centres are sampled with
+// subpixel precision and edges follow the top-left fill rule, so triangles
+// sharing an edge neither overlap nor leave gaps. Edges and attributes are
+// stepped with integer adds from values computed at the triangle's own
+// bounding box, which keeps the output independent of 'clip' and hence of
+// tiling and thread count.
+void triangle_fixed(TGAImage &image, const ScreenTriangle &t, DepthBuffer &zbuffer, const Texture &texture,
+                    const Vector3f &light, const Rect &clip);
+
+// Attribute of a triangle as a plane over the pixel grid, in the fixed-point
+// rasterizer's precision: origin + step_x * dx + step_y * dy, with dx and dy
+// relative to the corner of the triangle's bounds.
+struct AttributePlane
+{
+    long At(long dx, long dy) const { return origin + step_x * dx + step_y * dy; }
+
+    long origin;
+    long step_x;
+    long step_y;
+};
+
+// What the shading pass needs to reproduce any pixel of a triangle exactly
+// as triangle_fixed() draws it: the corner (x0, y0) of its bounds, the planes
+// of its texture coordinates and normal, its texture and its mip level.
+struct ShadingSetup
+{
+    long x0;
+    long y0;
+    AttributePlane ux;
+    AttributePlane uy;
+    AttributePlane nx;
+    AttributePlane ny;
+    AttributePlane nz;
+    const Texture *texture;
+    float lod;
+};
+
+ShadingSetup setup_shading(const ScreenTriangle &t, const Texture &texture);
+
+// Depth pass of a deferred triangle_fixed(): same coverage, depth and light
+// test, but a visible fragment stores only its depth and 'id'.
+void triangle_visibility(const ScreenTriangle &t, std::uint32_t id, DepthBuffer &zbuffer,
+                         VisibilityBuffer &visibility, const Vector3f &light, const Rect &clip);
+
+// Shading pass: colours every pixel of 'clip' that holds an id, with
+// 'setups' indexed by id. Each visible pixel is shaded exactly once.
+void shade_visibility(TGAImage &image, const VisibilityBuffer &visibility, const std::vector<ShadingSetup> &setups,
+                      const Vector3f &light, const Rect &clip);
+
+// Draws 't' with the rasterizer selected by 'mode'. 'hiz' is only used by
+// RASTER_EDGE; returns what triangle_edge() does, false for the others.
+bool rasterize(RasterMode mode, TGAImage &image, const ScreenTriangle &t, DepthBuffer &zbuffer,
+               const Texture &texture, Vector3f &light, const Rect &clip, HierarchicalZ *hiz = nullptr);
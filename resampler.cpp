@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+#include "resampler.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+namespace
+{
+
+// Taps of every output pixel along one axis: 'count' source indices starting
+// at 'first', with their normalized weights 'taps' floats apart.
+struct Contributions
+{
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<float> weights;
+    int taps;
+};
+
+float filter_support(TGAImage::Filter filter)
+{
+    switch (filter)
+    {
+        case TGAImage::BOX:      return 0.5f;
+        case TGAImage::BILINEAR: return 1.f;
+        default:                 return 2.f;
+    }
+}
+
+float filter_weight(TGAImage::Filter filter, float x)
+{
+    switch (filter)
+    {
+        case TGAImage::BOX:
+            return (x >= -0.5f && x < 0.5f) ? 1.f : 0.f;
+        case TGAImage::BILINEAR:
+            return std::max(0.f, 1.f - std::fabs(x));
+        default:
+        {
+            // Catmull-Rom
+            x = std::fabs(x);
+            if (x < 1.f)
+            {
+                return (1.5f * x - 2.5f) * x * x + 1.f;
+            }
+            if (x < 2.f)
+            {
+                return ((-0.5f * x + 2.5f) * x - 4.f) * x + 2.f;
+            }
+            return 0.f;
+        }
+    }
+}
+
+Contributions compute_contributions(int src_size, int dst_size, TGAImage::Filter filter)
+{
+    float scale = (float)src_size / dst_size;
+    float stretch = std::max(scale, 1.f);
+    float support = filter_support(filter) * stretch;
+
+    Contributions c;
+    c.taps = (int)std::ceil(2 * support) + 1;
+    c.first.resize(dst_size);
+    c.count.resize(dst_size);
+    c.weights.assign((std::size_t)dst_size * c.taps, 0.f);
+    for (int x = 0; x < dst_size; x++)
+    {
+        float center = (x + 0.5f) * scale;
+        int lo = std::max((int)std::floor(center - support), 0);
+        int hi = std::min((int)std::ceil(center + support), src_size - 1);
+        hi = std::min(hi, lo + c.taps - 1);
+        float *w = &c.weights[(std::size_t)x * c.taps];
+        float sum = 0.f;
+        for (int i = lo; i <= hi; i++)
+        {
+            w[i - lo] = filter_weight(filter, (i + 0.5f - center) / stretch);
+            sum += w[i - lo];
+        }
+        if (sum == 0.f)
+        {
+            // the filter missed every pixel centre; take the nearest one
+            lo = hi = std::min((int)center, src_size - 1);
+            w[0] = sum = 1.f;
+        }
+        for (int i = 0; i <= hi - lo; i++)
+        {
+            w[i] /= sum;
+        }
+        c.first[x] = lo;
+        c.count[x] = hi - lo + 1;
+    }
+    return c;
+}
+
+// Contributions regrouped for the horizontal pass: for every group of
+// simd::WIDTH consecutive output pixels and every tap, the source pixels
+// and the weights of the group's lanes side by side, so that one tap of the
+// whole group is a gather and a load. Lanes past the row, and taps past a
+// pixel's own count, read a valid pixel with weight 0.
+struct PackedContributions
+{
+    std::vector<int> sources;
+    std::vector<float> weights;
+    int taps;
+    int width;
+};
+
+PackedContributions pack_contributions(const Contributions &c, int src_size)
+{
+    const int width = c.first.size();
+    const int groups = (width + simd::WIDTH - 1) / simd::WIDTH;
+    PackedContributions p;
+    p.taps = c.taps;
+    p.width = width;
+    p.sources.assign((std::size_t)groups * c.taps * simd::WIDTH, 0);
+    p.weights.assign(p.sources.size(), 0.f);
+    for (int x = 0; x < width; x++)
+    {
+        int group = x / simd::WIDTH, lane = x % simd::WIDTH;
+        for (int t = 0; t < c.taps; t++)
+        {
+            std::size_t i = ((std::size_t)group * c.taps + t) * simd::WIDTH + lane;
+            p.sources[i] = std::min(c.first[x] + t, src_size - 1);
+            p.weights[i] = t < c.count[x] ? c.weights[(std::size_t)x * c.taps + t] : 0.f;
+        }
+    }
+    return p;
+}
+
+// Horizontal pass of one row of 4-byte pixels into dst_width * 4 floats,
+// one output pixel at a time: the four channels of a tap are one vector, so
+// the compiler vectorizes this better than gathering the channels apart.
+void resample_pixels(const unsigned char *src, float *dst, const Contributions &c)
+{
+    const int width = c.first.size();
+    for (int x = 0; x < width; x++)
+    {
+        const float *w = &c.weights[(std::size_t)x * c.taps];
+        const unsigned char *p = src + c.first[x] * 4;
+        float acc[4] = {};
+        for (int t = 0; t < c.count[x]; t++, p += 4)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                acc[k] += w[t] * p[k];
+            }
+        }
+        for (int k = 0; k < 4; k++)
+        {
+            dst[x * 4 + k] = acc[k];
+        }
+    }
+}
+
+// Horizontal pass of one row of 1- or 3-byte pixels into dst_width * BPP
+// floats. The row is split into one float array per channel in 'channels',
+// then every channel of simd::WIDTH output pixels is accumulated in one
+// register, with the taps gathered from the channel's array. The taps are
+// added in the same order as one pixel at a time, and the extra taps of
+// weight 0 add nothing, so the sums are those of the per-pixel loop.
+template <int BPP>
+void resample_row(const unsigned char *src, int src_width, float *channels, float *dst,
+                  const PackedContributions &p)
+{
+    using namespace simd;
+    for (int x = 0; x < src_width; x++)
+    {
+        for (int k = 0; k < BPP; k++)
+        {
+            channels[k * src_width + x] = src[x * BPP + k];
+        }
+    }
+
+    alignas(32) float lanes[BPP][WIDTH];
+    const int *sources = p.sources.data();
+    const float *weights = p.weights.data();
+    for (int x = 0; x < p.width; x += WIDTH)
+    {
+        FloatPack acc[BPP];
+        for (int k = 0; k < BPP; k++)
+        {
+            acc[k] = Set1(0.f);
+        }
+        for (int t = 0; t < p.taps; t++, sources += WIDTH, weights += WIDTH)
+        {
+            IntPack source = Load(sources);
+            FloatPack w = Load(weights);
+            for (int k = 0; k < BPP; k++)
+            {
+                acc[k] = acc[k] + w * Gather(channels + k * src_width, source);
+            }
+        }
+
+        int count = std::min(WIDTH, p.width - x);
+        for (int k = 0; k < BPP; k++)
+        {
+            Store(lanes[k], acc[k]);
+        }
+        for (int i = 0; i < count; i++)
+        {
+            for (int k = 0; k < BPP; k++)
+            {
+                dst[(x + i) * BPP + k] = lanes[k][i];
+            }
+        }
+    }
+}
+
+void resample_row(const unsigned char *src, int src_width, float *channels, float *dst, const Contributions &c,
+                  const PackedContributions &p, int bytespp)
+{
+    switch (bytespp)
+    {
+        case TGAImage::GRAYSCALE: resample_row<1>(src, src_width, channels, dst, p); break;
+        case TGAImage::RGB:       resample_row<3>(src, src_width, channels, dst, p); break;
+        default:                  resample_pixels(src, dst, c); break;
+    }
+}
+
+// Vertical pass: weighted sum of 'count' intermediate rows, then rounded and
+// clamped to bytes. Channels are interleaved, so the rows are plain float
+// arrays and the kernel does not care about the format.
+void blend_rows(const float *const *rows, const float *w, int count, int *rounded, unsigned char *dst, int n)
+{
+    using namespace simd;
+    int i = 0;
+    FloatPack zero = Set1(0.f), top = Set1(255.f), half = Set1(0.5f);
+    for (; i + WIDTH <= n; i += WIDTH)
+    {
+        FloatPack sum = Set1(0.f);
+        for (int t = 0; t < count; t++)
+        {
+            sum = sum + Set1(w[t]) * Load(rows[t] + i);
+        }
+        Store(rounded + i, Truncate(Min(Max(sum, zero), top) + half));
+    }
+    for (; i < n; i++)
+    {
+        float sum = 0.f;
+        for (int t = 0; t < count; t++)
+        {
+            sum += w[t] * rows[t][i];
+        }
+        rounded[i] = (int)(std::min(std::max(sum, 0.f), 255.f) + 0.5f);
+    }
+    for (i = 0; i < n; i++)
+    {
+        dst[i] = (unsigned char)rounded[i];
+    }
+}
+
+void parallel_rows(ThreadPool *pool, int rows, const std::function<void(int, int)> &band)
+{
+    std::size_t nbands = pool ? std::min<std::size_t>(rows, pool->GetThreadsCount() * 4) : 1;
+    if (nbands <= 1)
+    {
+        band(0, rows);
+        return;
+    }
+    pool->ParallelFor(nbands, [&](std::size_t b)
+    {
+        band(rows * b / nbands, rows * (b + 1) / nbands);
+    });
+}
+
+}
+
+bool resample(const TGAView &src, const TGAView &dst, TGAImage::Filter filter, ThreadPool *pool)
+{
+    if (!src.data || !dst.data || src.bytespp != dst.bytespp || src.width <= 0 || src.height <= 0 ||
+        dst.width <= 0 || dst.height <= 0)
+    {
+        return false;
+    }
+    const int bytespp = src.bytespp;
+    const int row_floats = dst.width * bytespp;
+    Contributions cx = compute_contributions(src.width, dst.width, filter);
+    PackedContributions packed;
+    if (bytespp != TGAImage::RGBA)
+    {
+        packed = pack_contributions(cx, src.width);
+    }
+    Contributions cy = compute_contributions(src.height, dst.height, filter);
+
+    std::vector<float> horizontal((std::size_t)src.height * row_floats);
+    parallel_rows(pool, src.height, [&](int y0, int y1)
+    {
+        std::vector<float> channels((std::size_t)src.width * bytespp);
+        for (int y = y0; y < y1; y++)
+        {
+            resample_row(src.row(y), src.width, channels.data(), &horizontal[(std::size_t)y * row_floats], cx,
+                         packed, bytespp);
+        }
+    });
+
+    parallel_rows(pool, dst.height, [&](int y0, int y1)
+    {
+        std::vector<const float *> rows(cy.taps);
+        std::vector<int> rounded(row_floats);
+        for (int y = y0; y < y1; y++)
+        {
+            for (int t = 0; t < cy.count[y]; t++)
+            {
+                rows[t] = &horizontal[(std::size_t)(cy.first[y] + t) * row_floats];
+            }
+            blend_rows(rows.data(), &cy.weights[(std::size_t)y * cy.taps], cy.count[y], rounded.data(),
+                       dst.row(y), row_floats);
+        }
+    });
+    return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "tgaimage.h"
+
+class ThreadPool;
+
+// Separable resampling of 'src' into 'dst' (both of the same format), with
+// the filter widened by the scale factor when minifying so that every source
+// pixel contributes. Rows are split across 'pool' when one is given.
+// Returns false when the formats differ or a view is empty.
+bool resample(const TGAView &src, const TGAView &dst, TGAImage::Filter filter, ThreadPool *pool = nullptr);
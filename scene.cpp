@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "scene.h"
+
+namespace
+{
+
+std::string resolve_path(const std::string &directory, const std::string &path)
+{
+    if (directory.empty() || path.empty() || path[0] == '/')
+    {
+        return path;
+    }
+    return directory + path;
+}
+
+// Name of the file 'path' names with no links, '.' or '..' left, so that
+// every name of a file finds the same copy; 'path' when it does not resolve.
+std::string canonical_path(const std::string &path)
+{
+    char *resolved = ::realpath(path.c_str(), nullptr);
+    if (!resolved)
+    {
+        return path;
+    }
+    std::string canonical(resolved);
+    std::free(resolved);
+    return canonical;
+}
+
+// "FILE:LINE: ", how every error of a scene file starts.
+std::string error_location(const char *p_filePath, unsigned long line_number)
+{
+    std::ostringstream location;
+    location << p_filePath << ":" << line_number << ": ";
+    return location.str();
+}
+
+// Distance from the origin of corner 'corner' (bit i picks max over min on
+// axis i) of the box [min, max] moved by the affine 'M'.
+float corner_distance(const Matrix4 &M, const Vector3f &min, const Vector3f &max, int corner)
+{
+    Vector3f p((corner & 1) ? max.x : min.x, (corner & 2) ? max.y : min.y, (corner & 4) ? max.z : min.z);
+    Vector3f q(M.m[0][0] * p.x + M.m[0][1] * p.y + M.m[0][2] * p.z + M.m[0][3],
+               M.m[1][0] * p.x + M.m[1][1] * p.y + M.m[1][2] * p.z + M.m[1][3],
+               M.m[2][0] * p.x + M.m[2][1] * p.y + M.m[2][2] * p.z + M.m[2][3]);
+    return q.len();
+}
+
+}
+
+Scene::Scene(bool use_mesh_cache, bool build_mipmaps)
+    : _UseMeshCache(use_mesh_cache), _BuildMipmaps(build_mipmaps), _Radius(0)
+{
+}
+
+void Scene::Load(const char *p_filePath)
+{
+    std::ifstream in(p_filePath);
+    if (!in)
+    {
+        throw std::runtime_error(std::string("Can not open scene '") + p_filePath + "'.");
+    }
+    std::string file_path = p_filePath;
+    std::string directory = file_path.substr(0, file_path.find_last_of('/') + 1);
+
+    std::map<std::string, std::size_t> meshes;
+    std::map<std::string, std::size_t> textures;
+    std::string line;
+    for (unsigned long line_number = 1; std::getline(in, line); line_number++)
+    {
+        std::istringstream fields(line.substr(0, line.find('#')));
+        std::string keyword;
+        if (!(fields >> keyword))
+        {
+            continue;
+        }
+
+        std::string error;
+        if (keyword == "mesh" || keyword == "texture")
+        {
+            std::string name, path;
+            if (!(fields >> name >> path))
+            {
+                error = "expected '" + keyword + " NAME FILE'";
+            }
+            else
+            {
+                try
+                {
+                    if (keyword == "mesh")
+                    {
+                        meshes[name] = AddMesh(resolve_path(directory, path));
+                    }
+                    else
+                    {
+                        textures[name] = AddTexture(resolve_path(directory, path));
+                    }
+                }
+                catch (const std::runtime_error &load_error)
+                {
+                    throw std::runtime_error(error_location(p_filePath, line_number) + load_error.what());
+                }
+            }
+        }
+        else if (keyword == "instance")
+        {
+            std::string mesh, texture;
+            Vector3f position;
+            std::vector<float> optional;
+            float value;
+            bool complete = (bool)(fields >> mesh >> texture >> position.x >> position.y >> position.z);
+            while (complete && optional.size() < 2 && fields >> value)
+            {
+                optional.push_back(value);
+            }
+            float yaw = optional.size() > 0 ? optional[0] : 0.f;
+            float scale = optional.size() > 1 ? optional[1] : 1.f;
+            // running out of fields ends the optional ones, anything else
+            // is malformed
+            if (!complete || (!fields && !fields.eof()))
+            {
+                error = "expected 'instance MESH TEXTURE X Y Z [YAW [SCALE]]'";
+            }
+            else if (scale <= 0)
+            {
+                error = "scale must be positive";
+            }
+            else if (meshes.find(mesh) == meshes.end())
+            {
+                error = "unknown mesh '" + mesh + "'";
+            }
+            else if (textures.find(texture) == textures.end())
+            {
+                error = "unknown texture '" + texture + "'";
+            }
+            else
+            {
+                AddInstance(meshes[mesh], textures[texture], Matrix4::translation(position) *
+                            Matrix4::rotation_y(yaw * M_PI / 180) * Matrix4::scaling(scale));
+            }
+        }
+        else
+        {
+            error = "unknown statement '" + keyword + "'";
+        }
+
+        std::string rest;
+        if (error.empty() && fields >> rest)
+        {
+            error = "unexpected '" + rest + "'";
+        }
+        if (!error.empty())
+        {
+            throw std::runtime_error(error_location(p_filePath, line_number) + error + ".");
+        }
+    }
+}
+
+std::size_t Scene::AddMesh(const std::string &path)
+{
+    std::string key = canonical_path(path);
+    std::map<std::string, std::size_t>::iterator found = _MeshFiles.find(key);
+    if (found != _MeshFiles.end())
+    {
+        return found->second;
+    }
+
+    std::unique_ptr<ObjModel> mesh(new ObjModel(path.c_str(), _UseMeshCache));
+    const ArrayView<Vector3f> &vertices = mesh->GetMeshArrays().vertices;
+    Vector3f min, max;
+    if (vertices.size() > 0)
+    {
+        min = max = vertices[0];
+    }
+    for (const Vector3f &v : vertices)
+    {
+        min = Vector3f(std::min(min.x, v.x), std::min(min.y, v.y), std::min(min.z, v.z));
+        max = Vector3f(std::max(max.x, v.x), std::max(max.y, v.y), std::max(max.z, v.z));
+    }
+
+    _Meshes.push_back(std::move(mesh));
+    _MeshMin.push_back(min);
+    _MeshMax.push_back(max);
+    _MeshFiles[key] = _Meshes.size() - 1;
+    return _Meshes.size() - 1;
+}
+
+std::size_t Scene::AddTexture(const std::string &path)
+{
+    std::string key = canonical_path(path);
+    std::map<std::string, std::size_t>::iterator found = _TextureFiles.find(key);
+    if (found != _TextureFiles.end())
+    {
+        return found->second;
+    }
+
+    std::unique_ptr<Texture> texture(new Texture());
+    if (!texture->Load(path.c_str(), _BuildMipmaps))
+    {
+        throw std::runtime_error("Can not load texture '" + path + "'.");
+    }
+    _Textures.push_back(std::move(texture));
+    _TextureFiles[key] = _Textures.size() - 1;
+    return _Textures.size() - 1;
+}
+
+void Scene::AddInstance(std::size_t mesh, std::size_t texture, const Matrix4 &to_world)
+{
+    std::vector<Batch>::iterator batch = _Batches.begin();
+    for (; batch != _Batches.end(); ++batch)
+    {
+        if (batch->mesh == mesh && batch->texture == texture)
+        {
+            break;
+        }
+    }
+    if (batch == _Batches.end())
+    {
+        Batch added;
+        added.mesh = mesh;
+        added.texture = texture;
+        batch = _Batches.insert(_Batches.end(), added);
+    }
+    batch->instances.push_back(to_world);
+
+    // the box is convex, so its farthest point from the origin is a corner
+    for (int corner = 0; corner < 8; corner++)
+    {
+        _Radius = std::max(_Radius, corner_distance(to_world, _MeshMin[mesh], _MeshMax[mesh], corner));
+    }
+}
+
+std::size_t Scene::GetInstancesCount() const
+{
+    std::size_t count = 0;
+    for (const Batch &batch : _Batches)
+    {
+        count += batch.instances.size();
+    }
+    return count;
+}
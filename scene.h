@@ -0,0 +1,79 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "geometry.h"
+#include "obj_model.h"
+#include "texture.h"
+
+// Meshes, textures and the instances drawing them. Every mesh and texture
+// file is loaded once however many instances use it, and the instances are
+// grouped into batches of the same mesh and texture, so that a renderer can
+// set up a mesh once and run all its instances through it. What the scene
+// holds grows with the number of distinct files; an instance costs one
+// matrix.
+//
+// A scene file has one statement per line, '#' starts a comment:
+//
+//   mesh NAME FILE.obj
+//   texture NAME FILE.tga
+//   instance MESH TEXTURE X Y Z [YAW [SCALE]]
+//
+// An instance is scaled by SCALE, turned by YAW degrees around the vertical
+// axis and moved to (X, Y, Z). Relative file names are taken from the
+// directory of the scene file.
+class Scene
+{
+    public:
+        struct Batch
+        {
+            std::size_t mesh;
+            std::size_t texture;
+            std::vector<Matrix4> instances;
+        };
+
+        Scene(bool use_mesh_cache = true, bool build_mipmaps = false);
+
+        // Adds the statements of a scene file. Throws std::runtime_error
+        // naming the file and line of the first error.
+        void Load(const char *p_filePath);
+
+        // Loading the same file twice, under any name, returns the index of
+        // the first copy.
+        // Both throw std::runtime_error when the file can not be loaded.
+        std::size_t AddMesh(const std::string &path);
+        std::size_t AddTexture(const std::string &path);
+
+        // 'to_world' maps the mesh from model to world space.
+        void AddInstance(std::size_t mesh, std::size_t texture, const Matrix4 &to_world);
+
+        std::size_t GetMeshesCount() const   { return _Meshes.size(); }
+        std::size_t GetTexturesCount() const { return _Textures.size(); }
+        std::size_t GetInstancesCount() const;
+        const ObjModel &GetMesh(std::size_t i) const { return *_Meshes[i]; }
+        Texture &GetTexture(std::size_t i)           { return *_Textures[i]; }
+        const std::vector<Batch> &GetBatches() const { return _Batches; }
+
+        // Radius of a sphere around the origin holding every instance,
+        // however the whole scene is turned around an axis through the
+        // origin.
+        float GetRadius() const { return _Radius; }
+
+    private:
+        bool _UseMeshCache;
+        bool _BuildMipmaps;
+
+        std::vector<std::unique_ptr<ObjModel> > _Meshes;
+        // Corners of the bounding box of each mesh.
+        std::vector<Vector3f> _MeshMin;
+        std::vector<Vector3f> _MeshMax;
+        std::vector<std::unique_ptr<Texture> > _Textures;
+        // Indices by canonical file name.
+        std::map<std::string, std::size_t> _MeshFiles;
+        std::map<std::string, std::size_t> _TextureFiles;
+
+        std::vector<Batch> _Batches;
+        float _Radius;
+};
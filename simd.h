@@ -0,0 +1,218 @@
+#pragma once
+
+// Thin wrappers over the widest integer/float vector registers the compiler
+// targets: AVX2 (8 lanes), SSE2 (4 lanes) or a plain scalar fallback (1 lane).
+// Only the handful of operations the renderer needs are provided.
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#endif
+
+namespace simd
+{
+
+#if defined(SIMD_AVX2)
+
+const int WIDTH = 8;
+
+struct FloatPack
+{
+    FloatPack() {};
+    FloatPack(__m256 _v) : v(_v) {};
+    __m256 v;
+};
+
+struct IntPack
+{
+    IntPack() {};
+    IntPack(__m256i _v) : v(_v) {};
+    __m256i v;
+};
+
+inline FloatPack Set1(float f)                  { return _mm256_set1_ps(f); }
+inline IntPack   Set1(int i)                    { return _mm256_set1_epi32(i); }
+inline IntPack   Load(const int *p)             { return _mm256_loadu_si256((const __m256i *)p); }
+inline FloatPack Load(const float *p)           { return _mm256_loadu_ps(p); }
+inline void      Store(int *p, IntPack a)       { _mm256_storeu_si256((__m256i *)p, a.v); }
+inline void      Store(float *p, FloatPack a)   { _mm256_storeu_ps(p, a.v); }
+// Lane i is p[indices[i]].
+inline FloatPack Gather(const float *p, IntPack indices) { return _mm256_i32gather_ps(p, indices.v, 4); }
+
+inline FloatPack operator+(FloatPack a, FloatPack b) { return _mm256_add_ps(a.v, b.v); }
+inline FloatPack operator-(FloatPack a, FloatPack b) { return _mm256_sub_ps(a.v, b.v); }
+inline FloatPack operator*(FloatPack a, FloatPack b) { return _mm256_mul_ps(a.v, b.v); }
+inline FloatPack operator/(FloatPack a, FloatPack b) { return _mm256_div_ps(a.v, b.v); }
+inline FloatPack Sqrt(FloatPack a)                   { return _mm256_sqrt_ps(a.v); }
+inline FloatPack Min(FloatPack a, FloatPack b)       { return _mm256_min_ps(a.v, b.v); }
+inline FloatPack Max(FloatPack a, FloatPack b)       { return _mm256_max_ps(a.v, b.v); }
+
+inline IntPack operator+(IntPack a, IntPack b) { return _mm256_add_epi32(a.v, b.v); }
+inline IntPack operator-(IntPack a, IntPack b) { return _mm256_sub_epi32(a.v, b.v); }
+inline IntPack operator|(IntPack a, IntPack b) { return _mm256_or_si256(a.v, b.v); }
+inline IntPack operator&(IntPack a, IntPack b) { return _mm256_and_si256(a.v, b.v); }
+inline IntPack CmpGt(IntPack a, IntPack b)     { return _mm256_cmpgt_epi32(a.v, b.v); }
+inline IntPack Min(IntPack a, IntPack b)       { return _mm256_min_epi32(a.v, b.v); }
+inline IntPack Max(IntPack a, IntPack b)       { return _mm256_max_epi32(a.v, b.v); }
+
+inline FloatPack ToFloat(IntPack a)    { return _mm256_cvtepi32_ps(a.v); }
+inline IntPack   Truncate(FloatPack a) { return _mm256_cvttps_epi32(a.v); }
+
+// One bit per lane, set when the lane's sign bit is set.
+inline int SignMask(IntPack a)   { return _mm256_movemask_ps(_mm256_castsi256_ps(a.v)); }
+inline int SignMask(FloatPack a) { return _mm256_movemask_ps(a.v); }
+
+// Lanes in reverse order.
+inline IntPack Reverse(IntPack a) { return _mm256_permutevar8x32_epi32(a.v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0)); }
+
+// All WIDTH * 4 bytes in reverse order: reversed within each 128-bit half,
+// then the halves swapped.
+inline IntPack ReverseBytes(IntPack a)
+{
+    __m256i in_halves = _mm256_shuffle_epi8(a.v, _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                                                  15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    return _mm256_permute2x128_si256(in_halves, in_halves, 1);
+}
+
+#elif defined(SIMD_SSE2)
+
+const int WIDTH = 4;
+
+struct FloatPack
+{
+    FloatPack() {};
+    FloatPack(__m128 _v) : v(_v) {};
+    __m128 v;
+};
+
+struct IntPack
+{
+    IntPack() {};
+    IntPack(__m128i _v) : v(_v) {};
+    __m128i v;
+};
+
+inline FloatPack Set1(float f)                  { return _mm_set1_ps(f); }
+inline IntPack   Set1(int i)                    { return _mm_set1_epi32(i); }
+inline IntPack   Load(const int *p)             { return _mm_loadu_si128((const __m128i *)p); }
+inline FloatPack Load(const float *p)           { return _mm_loadu_ps(p); }
+inline void      Store(int *p, IntPack a)       { _mm_storeu_si128((__m128i *)p, a.v); }
+inline void      Store(float *p, FloatPack a)   { _mm_storeu_ps(p, a.v); }
+inline FloatPack Gather(const float *p, IntPack indices)
+{
+    alignas(16) int i[4];
+    _mm_store_si128((__m128i *)i, indices.v);
+    return _mm_setr_ps(p[i[0]], p[i[1]], p[i[2]], p[i[3]]);
+}
+
+inline FloatPack operator+(FloatPack a, FloatPack b) { return _mm_add_ps(a.v, b.v); }
+inline FloatPack operator-(FloatPack a, FloatPack b) { return _mm_sub_ps(a.v, b.v); }
+inline FloatPack operator*(FloatPack a, FloatPack b) { return _mm_mul_ps(a.v, b.v); }
+inline FloatPack operator/(FloatPack a, FloatPack b) { return _mm_div_ps(a.v, b.v); }
+inline FloatPack Sqrt(FloatPack a)                   { return _mm_sqrt_ps(a.v); }
+inline FloatPack Min(FloatPack a, FloatPack b)       { return _mm_min_ps(a.v, b.v); }
+inline FloatPack Max(FloatPack a, FloatPack b)       { return _mm_max_ps(a.v, b.v); }
+
+inline IntPack operator+(IntPack a, IntPack b) { return _mm_add_epi32(a.v, b.v); }
+inline IntPack operator-(IntPack a, IntPack b) { return _mm_sub_epi32(a.v, b.v); }
+inline IntPack operator|(IntPack a, IntPack b) { return _mm_or_si128(a.v, b.v); }
+inline IntPack operator&(IntPack a, IntPack b) { return _mm_and_si128(a.v, b.v); }
+inline IntPack CmpGt(IntPack a, IntPack b)     { return _mm_cmpgt_epi32(a.v, b.v); }
+inline IntPack Min(IntPack a, IntPack b)
+{
+    __m128i gt = _mm_cmpgt_epi32(a.v, b.v);
+    return _mm_or_si128(_mm_and_si128(gt, b.v), _mm_andnot_si128(gt, a.v));
+}
+inline IntPack Max(IntPack a, IntPack b)
+{
+    __m128i gt = _mm_cmpgt_epi32(a.v, b.v);
+    return _mm_or_si128(_mm_and_si128(gt, a.v), _mm_andnot_si128(gt, b.v));
+}
+
+inline FloatPack ToFloat(IntPack a)    { return _mm_cvtepi32_ps(a.v); }
+inline IntPack   Truncate(FloatPack a) { return _mm_cvttps_epi32(a.v); }
+
+inline int SignMask(IntPack a)   { return _mm_movemask_ps(_mm_castsi128_ps(a.v)); }
+inline int SignMask(FloatPack a) { return _mm_movemask_ps(a.v); }
+
+inline IntPack Reverse(IntPack a) { return _mm_shuffle_epi32(a.v, _MM_SHUFFLE(0, 1, 2, 3)); }
+
+// SSE2 has no byte shuffle: lanes, then the words in each lane, then the
+// bytes in each word are swapped.
+inline IntPack ReverseBytes(IntPack a)
+{
+    __m128i words = _mm_shuffle_epi32(a.v, _MM_SHUFFLE(0, 1, 2, 3));
+    words = _mm_shufflelo_epi16(words, _MM_SHUFFLE(2, 3, 0, 1));
+    words = _mm_shufflehi_epi16(words, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+}
+
+#else
+
+const int WIDTH = 1;
+
+struct FloatPack
+{
+    FloatPack() {};
+    FloatPack(float _v) : v(_v) {};
+    float v;
+};
+
+struct IntPack
+{
+    IntPack() {};
+    IntPack(int _v) : v(_v) {};
+    int v;
+};
+
+inline FloatPack Set1(float f)                  { return f; }
+inline IntPack   Set1(int i)                    { return i; }
+inline IntPack   Load(const int *p)             { return *p; }
+inline FloatPack Load(const float *p)           { return *p; }
+inline void      Store(int *p, IntPack a)       { *p = a.v; }
+inline void      Store(float *p, FloatPack a)   { *p = a.v; }
+inline FloatPack Gather(const float *p, IntPack indices) { return p[indices.v]; }
+
+inline FloatPack operator+(FloatPack a, FloatPack b) { return a.v + b.v; }
+inline FloatPack operator-(FloatPack a, FloatPack b) { return a.v - b.v; }
+inline FloatPack operator*(FloatPack a, FloatPack b) { return a.v * b.v; }
+inline FloatPack operator/(FloatPack a, FloatPack b) { return a.v / b.v; }
+inline FloatPack Sqrt(FloatPack a)                   { return __builtin_sqrtf(a.v); }
+inline FloatPack Min(FloatPack a, FloatPack b)       { return a.v < b.v ? a.v : b.v; }
+inline FloatPack Max(FloatPack a, FloatPack b)       { return a.v > b.v ? a.v : b.v; }
+
+inline IntPack operator+(IntPack a, IntPack b) { return a.v + b.v; }
+inline IntPack operator-(IntPack a, IntPack b) { return a.v - b.v; }
+inline IntPack operator|(IntPack a, IntPack b) { return a.v | b.v; }
+inline IntPack operator&(IntPack a, IntPack b) { return a.v & b.v; }
+inline IntPack CmpGt(IntPack a, IntPack b)     { return a.v > b.v ? -1 : 0; }
+inline IntPack Min(IntPack a, IntPack b)       { return a.v < b.v ? a.v : b.v; }
+inline IntPack Max(IntPack a, IntPack b)       { return a.v > b.v ? a.v : b.v; }
+
+inline FloatPack ToFloat(IntPack a)    { return (float)a.v; }
+inline IntPack   Truncate(FloatPack a) { return (int)a.v; }
+
+inline int SignMask(IntPack a)   { return a.v < 0 ? 1 : 0; }
+inline int SignMask(FloatPack a) { return a.v < 0 ? 1 : 0; }
+
+inline IntPack Reverse(IntPack a) { return a; }
+
+inline IntPack ReverseBytes(IntPack a) { return (int)__builtin_bswap32((unsigned)a.v); }
+
+#endif
+
+// Lane indices 0, 1, ..., WIDTH-1.
+inline IntPack LaneIndex()
+{
+    int lanes[WIDTH];
+    for (int i = 0; i < WIDTH; i++)
+    {
+        lanes[i] = i;
+    }
+    return Load(lanes);
+}
+
+}
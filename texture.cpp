@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cmath>
+#include "texture.h"
+#include "profiler.h"
+
+// Bit interleaving of the low three coordinate bits: x goes to the even
+// bits, y to the odd bits of the index inside a tile.
+const std::uint8_t Texture::MORTON_X[TILE_SIZE] = {0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15};
+const std::uint8_t Texture::MORTON_Y[TILE_SIZE] = {0x00, 0x02, 0x08, 0x0a, 0x20, 0x22, 0x28, 0x2a};
+
+static inline
+std::uint32_t lerp_texel(std::uint32_t a, std::uint32_t b, float t)
+{
+    std::uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        float ca = (a >> shift) & 0xff;
+        float cb = (b >> shift) & 0xff;
+        result |= (std::uint32_t)(ca + (cb - ca) * t + 0.5f) << shift;
+    }
+    return result;
+}
+
+Texture::Texture() : _WrapMode(WRAP_BORDER)
+{
+}
+
+void Texture::Allocate(Level &level, int width, int height)
+{
+    level.width = width;
+    level.height = height;
+    level.tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    unsigned long tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    level.texels.assign(level.tiles_x * tiles_y * TILE_SIZE * TILE_SIZE, 0);
+}
+
+bool Texture::Load(const TGAView &view, bool build_mipmaps)
+{
+    const int bytespp = view.bytespp;
+    if (!view.data || view.width <= 0 || view.height <= 0)
+    {
+        return false;
+    }
+
+    _Levels.assign(1, Level());
+    Level &base = _Levels[0];
+    Allocate(base, view.width, view.height);
+
+    for (int y = 0; y < base.height; y++)
+    {
+        const unsigned char *row = view.row(y);
+        for (int x = 0; x < base.width; x++)
+        {
+            const unsigned char *p = row + x * bytespp;
+            std::uint32_t texel;
+            switch (bytespp)
+            {
+                case TGAImage::GRAYSCALE:
+                    texel = p[0] | (p[0] << 8) | (p[0] << 16) | 0xff000000u;
+                    break;
+                case TGAImage::RGB:
+                    texel = p[0] | (p[1] << 8) | (p[2] << 16) | 0xff000000u;
+                    break;
+                default:
+                    texel = p[0] | (p[1] << 8) | (p[2] << 16) | ((std::uint32_t)p[3] << 24);
+                    break;
+            }
+            base.texels[base.GetOffset(x, y)] = texel;
+        }
+    }
+
+    if (build_mipmaps)
+    {
+        BuildMipmaps();
+    }
+    return true;
+}
+
+bool Texture::Load(const char *p_filePath, bool build_mipmaps)
+{
+    PROFILE_SCOPE(STAGE_TEXTURE_LOAD);
+    TGAImage image;
+    if (!image.read_tga_file(p_filePath))
+    {
+        return false;
+    }
+    image.flip_vertically();
+    return Load(image, build_mipmaps);
+}
+
+void Texture::BuildMipmaps()
+{
+    while (_Levels.back().width > 1 || _Levels.back().height > 1)
+    {
+        _Levels.push_back(Level());
+        const Level &src = _Levels[_Levels.size() - 2];
+        Level &dst = _Levels.back();
+        Allocate(dst, std::max(1, src.width / 2), std::max(1, src.height / 2));
+
+        // 2x2 box filter; an odd last row or column is folded into the
+        // previous output texel so that no source texel is lost.
+        for (int y = 0; y < dst.height; y++)
+        {
+            int y0 = 2 * y;
+            int y1 = std::min(y0 + 1, src.height - 1);
+            int y2 = (y == dst.height - 1 && src.height > 1 && src.height % 2) ? src.height - 1 : y1;
+            for (int x = 0; x < dst.width; x++)
+            {
+                int x0 = 2 * x;
+                int x1 = std::min(x0 + 1, src.width - 1);
+                int x2 = (x == dst.width - 1 && src.width > 1 && src.width % 2) ? src.width - 1 : x1;
+
+                const int xs[3] = {x0, x1, x2};
+                const int ys[3] = {y0, y1, y2};
+                int nx = (x2 != x1) ? 3 : 2;
+                int ny = (y2 != y1) ? 3 : 2;
+                std::uint32_t sum[4] = {0, 0, 0, 0};
+                for (int j = 0; j < ny; j++)
+                {
+                    for (int i = 0; i < nx; i++)
+                    {
+                        std::uint32_t texel = src.texels[src.GetOffset(xs[i], ys[j])];
+                        for (int c = 0; c < 4; c++)
+                        {
+                            sum[c] += (texel >> (8 * c)) & 0xff;
+                        }
+                    }
+                }
+                std::uint32_t count = nx * ny;
+                std::uint32_t texel = 0;
+                for (int c = 0; c < 4; c++)
+                {
+                    texel |= ((sum[c] + count / 2) / count) << (8 * c);
+                }
+                dst.texels[dst.GetOffset(x, y)] = texel;
+            }
+        }
+    }
+}
+
+float Texture::GetLod(float texel_area, float pixel_area) const
+{
+    if (_Levels.size() < 2 || pixel_area <= 0.f || texel_area <= 0.f)
+    {
+        return 0.f;
+    }
+    float lod = 0.5f * std::log2(texel_area / pixel_area);
+    return std::min(lod, (float)(_Levels.size() - 1));
+}
+
+std::uint32_t Texture::SampleBilinear(int level, float x, float y) const
+{
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+    long x0 = (long)fx;
+    long y0 = (long)fy;
+    float tx = x - fx;
+    float ty = y - fy;
+    std::uint32_t top = lerp_texel(FetchLevel(level, x0, y0), FetchLevel(level, x0 + 1, y0), tx);
+    std::uint32_t bottom = lerp_texel(FetchLevel(level, x0, y0 + 1), FetchLevel(level, x0 + 1, y0 + 1), tx);
+    return lerp_texel(top, bottom, ty);
+}
+
+std::uint32_t Texture::SampleTrilinear(long x, long y, float lod) const
+{
+    int level = (int)lod;
+    float t = lod - level;
+    int last = _Levels.size() - 1;
+
+    // texel centres of the base level expressed in the coordinates of 'l'
+    float scale = 1.f / (1 << level);
+    float lx = (x + 0.5f) * scale - 0.5f;
+    float ly = (y + 0.5f) * scale - 0.5f;
+    std::uint32_t fine = SampleBilinear(std::min(level, last), lx, ly);
+    if (t <= 0.f || level >= last)
+    {
+        return fine;
+    }
+    std::uint32_t coarse = SampleBilinear(level + 1, (lx + 0.5f) * 0.5f - 0.5f, (ly + 0.5f) * 0.5f - 0.5f);
+    return lerp_texel(fine, coarse, t);
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "tgaimage.h"
+
+// Sampling copy of a TGAImage. Texels are expanded to 4-byte BGRA (the
+// TGAColor layout) and stored in 8x8 tiles of one 256-byte span each, with
+// the texels inside a tile in Morton (Z) order. Neighbouring texels in any
+// direction thus share cache lines, which keeps fetches along rotated
+// triangles cheap.
+//
+// Optionally a mip chain of box-filtered levels is built, each half the size
+// of the previous one, down to 1x1.
+class Texture
+{
+    public:
+        enum WrapMode
+        {
+            WRAP_BORDER,    // outside texels read as transparent black
+            WRAP_CLAMP,     // coordinates are clamped to the edge texels
+            WRAP_REPEAT     // coordinates wrap around
+        };
+
+        static const int TILE_SIZE = 8;
+
+        Texture();
+
+        // Builds the texture from 'image' or a view into one; GRAYSCALE
+        // texels are replicated into the three colour channels.
+        bool Load(const TGAView &view, bool build_mipmaps = false);
+        bool Load(TGAImage &image, bool build_mipmaps = false) { return Load(image.view(), build_mipmaps); }
+        // Reads a TGA file, flipped so that texture row 0 is the bottom one.
+        bool Load(const char *p_filePath, bool build_mipmaps = false);
+
+        int GetWidth() const  { return _Levels.empty() ? 0 : _Levels[0].width; }
+        int GetHeight() const { return _Levels.empty() ? 0 : _Levels[0].height; }
+        int GetLevelsCount() const { return _Levels.size(); }
+
+        void SetWrapMode(WrapMode mode) { _WrapMode = mode; }
+        WrapMode GetWrapMode() const    { return _WrapMode; }
+
+        // Texel of the base level at integer coordinates, as BGRA packed into
+        // a TGAColor::val.
+        inline std::uint32_t Fetch(long x, long y) const { return FetchLevel(0, x, y); }
+        inline TGAColor Sample(long x, long y) const { return TGAColor((int)Fetch(x, y), 4); }
+
+        // Level of detail for a triangle covering 'texel_area' base level
+        // texels with 'pixel_area' pixels: log2 of the texel footprint of a
+        // pixel. Returns 0 without mipmaps.
+        float GetLod(float texel_area, float pixel_area) const;
+
+        // Trilinear sample at base level texel coordinates, packed as Fetch
+        // packs it. A 'lod' of 0 or less is the plain base level fetch.
+        inline std::uint32_t FetchFiltered(long x, long y, float lod) const
+        {
+            if (lod <= 0.f)
+            {
+                return Fetch(x, y);
+            }
+            return SampleTrilinear(x, y, lod);
+        }
+        inline TGAColor Sample(long x, long y, float lod) const
+        {
+            return TGAColor((int)FetchFiltered(x, y, lod), 4);
+        }
+
+    private:
+        struct Level
+        {
+            int width;
+            int height;
+            unsigned long tiles_x;
+            std::vector<std::uint32_t> texels;
+
+            std::size_t GetOffset(unsigned long x, unsigned long y) const
+            {
+                return (((y >> 3) * tiles_x + (x >> 3)) << 6) | MORTON_X[x & 7] | MORTON_Y[y & 7];
+            }
+        };
+
+        static void Allocate(Level &level, int width, int height);
+        void BuildMipmaps();
+        std::uint32_t SampleBilinear(int level, float x, float y) const;
+        std::uint32_t SampleTrilinear(long x, long y, float lod) const;
+
+        inline std::uint32_t FetchLevel(int level, long x, long y) const;
+        inline long Wrap(long c, long size) const;
+
+        static const std::uint8_t MORTON_X[TILE_SIZE];
+        static const std::uint8_t MORTON_Y[TILE_SIZE];
+
+        WrapMode _WrapMode;
+        std::vector<Level> _Levels;
+};
+
+inline long Texture::Wrap(long c, long size) const
+{
+    if (_WrapMode == WRAP_CLAMP)
+    {
+        return c < 0 ? 0 : (c >= size ? size - 1 : c);
+    }
+    long r = c % size;
+    return r < 0 ? r + size : r;
+}
+
+inline std::uint32_t Texture::FetchLevel(int level, long x, long y) const
+{
+    if (_Levels.empty())
+    {
+        return 0;
+    }
+    const Level &l = _Levels[level];
+    if ((unsigned long)x >= (unsigned long)l.width || (unsigned long)y >= (unsigned long)l.height)
+    {
+        if (_WrapMode == WRAP_BORDER)
+        {
+            return 0;
+        }
+        x = Wrap(x, l.width);
+        y = Wrap(y, l.height);
+    }
+    return l.texels[l.GetOffset(x, y)];
+}
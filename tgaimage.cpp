@@ -1,48 +1,189 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <stdint.h>
+#include <mutex>
+#include <utility>
+#include <vector>
 #include "tgaimage.h"
+#include "profiler.h"
+#include "resampler.h"
+#include "simd.h"
+#include "thread_pool.h"
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
 
-TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {
+// Pixel buffers are 64-byte aligned and recycled through a small pool, so
+// images created over and over (loads, scales, per-frame scratch) mostly
+// reuse memory instead of going to the allocator.
+static const unsigned long PIXEL_ALIGNMENT = 64;
+static const size_t PIXEL_POOL_SIZE = 8;
+
+struct PixelBuffer {
+	unsigned char *allocation;
+	unsigned long capacity;
+};
+
+struct PixelPool {
+	std::mutex mutex;
+	std::vector<PixelBuffer> buffers;
+};
+
+static PixelPool &pixel_pool() {
+	// never destroyed: images with static storage may outlive it otherwise
+	static PixelPool *pool = new PixelPool;
+	return *pool;
+}
+
+static PixelBuffer acquire_pixels(unsigned long nbytes) {
+	PixelPool &pool = pixel_pool();
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		size_t best = pool.buffers.size();
+		for (size_t i=0; i<pool.buffers.size(); i++) {
+			unsigned long c = pool.buffers[i].capacity;
+			// a much larger buffer would waste memory for the image's lifetime
+			if (c>=nbytes && c/2<=nbytes && (best==pool.buffers.size() || c<pool.buffers[best].capacity)) {
+				best = i;
+			}
+		}
+		if (best<pool.buffers.size()) {
+			PixelBuffer buffer = pool.buffers[best];
+			pool.buffers.erase(pool.buffers.begin()+best);
+			return buffer;
+		}
+	}
+	PixelBuffer buffer;
+	buffer.allocation = new unsigned char[nbytes+PIXEL_ALIGNMENT];
+	buffer.capacity = nbytes;
+	return buffer;
+}
+
+static void release_pixels(PixelBuffer buffer) {
+	if (!buffer.allocation) return;
+	PixelPool &pool = pixel_pool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	if (pool.buffers.size()>=PIXEL_POOL_SIZE) {
+		delete [] pool.buffers.front().allocation;
+		pool.buffers.erase(pool.buffers.begin());
+	}
+	pool.buffers.push_back(buffer);
+}
+
+static unsigned char *align_pixels(unsigned char *allocation) {
+	uintptr_t address = (uintptr_t)allocation;
+	return allocation+(PIXEL_ALIGNMENT-address%PIXEL_ALIGNMENT)%PIXEL_ALIGNMENT;
+}
+
+bool TGAView::set(int x, int y, TGAColor c) const {
+	if (!data || x<0 || y<0 || x>=width || y>=height) {
+		return false;
+	}
+	memcpy(row(y)+x*bytespp, c.raw, bytespp);
+	return true;
 }
 
-TGAImage::TGAImage(int w, int h, int bpp) : data(NULL), width(w), height(h), bytespp(bpp) {
+TGAView TGAView::sub(int x, int y, int w, int h) const {
+	int x0 = std::max(x, 0), y0 = std::max(y, 0);
+	int x1 = std::min(x+w, width), y1 = std::min(y+h, height);
+	if (!data || x0>=x1 || y0>=y1) {
+		return TGAView();
+	}
+	return TGAView(row(y0)+x0*bytespp, x1-x0, y1-y0, bytespp, stride);
+}
+
+void TGAImage::allocate(unsigned long nbytes) {
+	release();
+	PixelBuffer buffer = acquire_pixels(nbytes);
+	allocation = buffer.allocation;
+	capacity = buffer.capacity;
+	data = align_pixels(allocation);
+}
+
+void TGAImage::release() {
+	PixelBuffer buffer = {allocation, capacity};
+	release_pixels(buffer);
+	data = NULL;
+	allocation = NULL;
+	capacity = 0;
+}
+
+TGAImage::TGAImage() : data(NULL), allocation(NULL), capacity(0), width(0), height(0), bytespp(0), bottom_up(false) {
+}
+
+TGAImage::TGAImage(int w, int h, int bpp) : data(NULL), allocation(NULL), capacity(0), width(w), height(h), bytespp(bpp), bottom_up(false) {
 	unsigned long nbytes = width*height*bytespp;
-	data = new unsigned char[nbytes];
+	allocate(nbytes);
 	memset(data, 0, nbytes);
 }
 
-TGAImage::TGAImage(const TGAImage &img) {
+TGAImage::TGAImage(const TGAImage &img) : data(NULL), allocation(NULL), capacity(0) {
 	width = img.width;
 	height = img.height;
 	bytespp = img.bytespp;
+	bottom_up = img.bottom_up;
 	unsigned long nbytes = width*height*bytespp;
-	data = new unsigned char[nbytes];
+	allocate(nbytes);
 	memcpy(data, img.data, nbytes);
 }
 
+TGAImage::TGAImage(TGAImage &&img) : data(img.data), allocation(img.allocation), capacity(img.capacity),
+	width(img.width), height(img.height), bytespp(img.bytespp), bottom_up(img.bottom_up) {
+	img.data = NULL;
+	img.allocation = NULL;
+	img.capacity = 0;
+	img.width = img.height = img.bytespp = 0;
+}
+
+TGAImage::TGAImage(const TGAView &view) : data(NULL), allocation(NULL), capacity(0), width(view.width), height(view.height), bytespp(view.bytespp), bottom_up(false) {
+	unsigned long linebytes = width*bytespp;
+	allocate(linebytes*height);
+	for (int y=0; y<height; y++) {
+		memcpy(data+y*linebytes, view.row(y), linebytes);
+	}
+}
+
 TGAImage::~TGAImage() {
-	if (data) delete [] data;
+	release();
 }
 
 TGAImage & TGAImage::operator =(const TGAImage &img) {
 	if (this != &img) {
-		if (data) delete [] data;
 		width  = img.width;
 		height = img.height;
 		bytespp = img.bytespp;
+		bottom_up = img.bottom_up;
 		unsigned long nbytes = width*height*bytespp;
-		data = new unsigned char[nbytes];
+		allocate(nbytes);
 		memcpy(data, img.data, nbytes);
 	}
 	return *this;
 }
 
+TGAImage & TGAImage::operator =(TGAImage &&img) {
+	if (this != &img) {
+		release();
+		data = img.data;
+		allocation = img.allocation;
+		capacity = img.capacity;
+		width  = img.width;
+		height = img.height;
+		bytespp = img.bytespp;
+		bottom_up = img.bottom_up;
+		img.data = NULL;
+		img.allocation = NULL;
+		img.capacity = 0;
+		img.width = img.height = img.bytespp = 0;
+	}
+	return *this;
+}
+
 bool TGAImage::read_tga_file(const char *filename) {
-	if (data) delete [] data;
-	data = NULL;
+	release();
 	std::ifstream in;
 	in.open (filename, std::ios::binary);
 	if (!in.is_open()) {
@@ -66,7 +207,7 @@ bool TGAImage::read_tga_file(const char *filename) {
 		return false;
 	}
 	unsigned long nbytes = bytespp*width*height;
-	data = new unsigned char[nbytes];
+	allocate(nbytes);
 	if (3==header.datatypecode || 2==header.datatypecode) {
 		in.read((char *)data, nbytes);
 		if (!in.good()) {
@@ -85,9 +226,8 @@ bool TGAImage::read_tga_file(const char *filename) {
 		std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
 		return false;
 	}
-	if (!(header.imagedescriptor & 0x20)) {
-		flip_vertically();
-	}
+	// the storage keeps the file's row order
+	bottom_up = !(header.imagedescriptor & 0x20);
 	if (header.imagedescriptor & 0x10) {
 		flip_horizontally();
 	}
@@ -96,56 +236,75 @@ bool TGAImage::read_tga_file(const char *filename) {
 	return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream &in) {
-	unsigned long pixelcount = width*height;
+// Replicates the pixel at dst into count pixels by doubling the filled span.
+static void fill_run(unsigned char *dst, const unsigned char *pixel, unsigned long count, int bytespp) {
+	if (1==bytespp) {
+		memset(dst, pixel[0], count);
+		return;
+	}
+	unsigned long total  = count*bytespp;
+	unsigned long filled = bytespp;
+	memcpy(dst, pixel, bytespp);
+	while (filled<total) {
+		unsigned long n = std::min(filled, total-filled);
+		memcpy(dst+filled, dst, n);
+		filled += n;
+	}
+}
+
+// Expands the whole RLE payload held in memory; every packet is bounds
+// checked against both the input and the pixel buffer.
+static bool decode_rle(const unsigned char *src, unsigned long src_size, unsigned char *dst, unsigned long npixels, int bytespp) {
+	const unsigned char *end = src+src_size;
 	unsigned long currentpixel = 0;
-	unsigned long currentbyte  = 0;
-	TGAColor colorbuffer;
-	do {
-		unsigned char chunkheader = 0;
-		chunkheader = in.get();
-		if (!in.good()) {
+	while (currentpixel<npixels) {
+		if (src>=end) {
+			std::cerr << "an error occured while reading the data\n";
+			return false;
+		}
+		unsigned char chunkheader = *src++;
+		unsigned long count = chunkheader<128 ? chunkheader+1 : chunkheader-127;
+		if (count>npixels-currentpixel) {
+			std::cerr << "Too many pixels read\n";
+			return false;
+		}
+		unsigned long nbytes = chunkheader<128 ? count*bytespp : bytespp;
+		if ((unsigned long)(end-src)<nbytes) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
 		if (chunkheader<128) {
-			chunkheader++;
-			for (int i=0; i<chunkheader; i++) {
-				in.read((char *)colorbuffer.raw, bytespp);
-				if (!in.good()) {
-					std::cerr << "an error occured while reading the header\n";
-					return false;
-				}
-				for (int t=0; t<bytespp; t++)
-					data[currentbyte++] = colorbuffer.raw[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
-			}
+			memcpy(dst, src, nbytes);
 		} else {
-			chunkheader -= 127;
-			in.read((char *)colorbuffer.raw, bytespp);
-			if (!in.good()) {
-				std::cerr << "an error occured while reading the header\n";
-				return false;
-			}
-			for (int i=0; i<chunkheader; i++) {
-				for (int t=0; t<bytespp; t++)
-					data[currentbyte++] = colorbuffer.raw[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
-			}
+			fill_run(dst, src, count, bytespp);
 		}
-	} while (currentpixel < pixelcount);
+		src += nbytes;
+		dst += count*bytespp;
+		currentpixel += count;
+	}
 	return true;
 }
 
-bool TGAImage::write_tga_file(const char *filename, bool rle) {
+bool TGAImage::load_rle_data(std::ifstream &in) {
+	std::streampos start = in.tellg();
+	in.seekg(0, std::ios::end);
+	std::streamoff payload = in.tellg()-start;
+	in.seekg(start);
+	if (!in.good() || payload<=0) {
+		std::cerr << "an error occured while reading the data\n";
+		return false;
+	}
+	std::vector<unsigned char> rle(payload);
+	in.read((char *)rle.data(), payload);
+	if (!in.good()) {
+		std::cerr << "an error occured while reading the data\n";
+		return false;
+	}
+	return decode_rle(rle.data(), rle.size(), data, (unsigned long)width*height, bytespp);
+}
+
+bool TGAImage::write_tga_file(const char *filename, bool rle, ThreadPool *pool) {
+	PROFILE_SCOPE(STAGE_TGA_WRITE);
 	unsigned char developer_area_ref[4] = {0, 0, 0, 0};
 	unsigned char extension_area_ref[4] = {0, 0, 0, 0};
 	unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
@@ -162,40 +321,19 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
 	header.width  = width;
 	header.height = height;
 	header.datatypecode = (bytespp==GRAYSCALE?(rle?11:3):(rle?10:2));
-	header.imagedescriptor = 0x20; // top-left origin
-	out.write((char *)&header, sizeof(header));
-	if (!out.good()) {
-		out.close();
-		std::cerr << "can't dump the tga file\n";
-		return false;
-	}
+	header.imagedescriptor = bottom_up ? 0x00 : 0x20; // bottom-left or top-left origin, as stored
+
+	// the whole file is assembled in memory and dumped with a single write
+	std::vector<unsigned char> file((unsigned char *)&header, (unsigned char *)&header+sizeof(header));
 	if (!rle) {
-		out.write((char *)data, width*height*bytespp);
-		if (!out.good()) {
-			std::cerr << "can't unload raw data\n";
-			out.close();
-			return false;
-		}
+		file.insert(file.end(), data, data+width*height*bytespp);
 	} else {
-		if (!unload_rle_data(out)) {
-			out.close();
-			std::cerr << "can't unload rle data\n";
-			return false;
-		}
-	}
-	out.write((char *)developer_area_ref, sizeof(developer_area_ref));
-	if (!out.good()) {
-		std::cerr << "can't dump the tga file\n";
-		out.close();
-		return false;
-	}
-	out.write((char *)extension_area_ref, sizeof(extension_area_ref));
-	if (!out.good()) {
-		std::cerr << "can't dump the tga file\n";
-		out.close();
-		return false;
+		unload_rle_data(file, pool);
 	}
-	out.write((char *)footer, sizeof(footer));
+	file.insert(file.end(), developer_area_ref, developer_area_ref+sizeof(developer_area_ref));
+	file.insert(file.end(), extension_area_ref, extension_area_ref+sizeof(extension_area_ref));
+	file.insert(file.end(), footer, footer+sizeof(footer));
+	out.write((char *)file.data(), file.size());
 	if (!out.good()) {
 		std::cerr << "can't dump the tga file\n";
 		out.close();
@@ -205,53 +343,119 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
 	return true;
 }
 
-// TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream &out) {
-	const unsigned char max_chunk_length = 128;
-	unsigned long npixels = width*height;
+// Pixels are widened to a word so that comparing two of them is a single
+// compare. The bytes are assembled explicitly: a partial memcpy into a word
+// would stall on store forwarding for every pixel.
+template <int BPP>
+static inline unsigned int load_pixel(const unsigned char *p);
+
+template <>
+inline unsigned int load_pixel<1>(const unsigned char *p) {
+	return p[0];
+}
+
+template <>
+inline unsigned int load_pixel<3>(const unsigned char *p) {
+	return p[0] | (p[1]<<8) | (p[2]<<16);
+}
+
+template <>
+inline unsigned int load_pixel<4>(const unsigned char *p) {
+	unsigned int v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+// Worst case size of the RLE encoding: every packet either saves at least
+// its header byte or is a full raw packet of 128 pixels.
+static unsigned long rle_bound(unsigned long npixels, int bytespp) {
+	return npixels*bytespp+(npixels+127)/128+1;
+}
+
+// Encodes npixels pixels into RLE packets at dst and returns the number of
+// bytes written. Pixels are compared as whole words. A run packet is
+// started for two equal pixels, or three for grayscale where a run of two
+// is no shorter than raw bytes.
+template <int BPP>
+static unsigned long encode_rle(const unsigned char *src, unsigned long npixels, unsigned char *dst) {
+	const unsigned long max_chunk_length = 128;
+	const unsigned long min_run_length = BPP>1 ? 2 : 3;
+	unsigned char *begin = dst;
 	unsigned long curpix = 0;
 	while (curpix<npixels) {
-		unsigned long chunkstart = curpix*bytespp;
-		unsigned long curbyte = curpix*bytespp;
-		unsigned char run_length = 1;
-		bool raw = true;
-		while (curpix+run_length<npixels && run_length<max_chunk_length) {
-			bool succ_eq = true;
-			for (int t=0; succ_eq && t<bytespp; t++) {
-				succ_eq = (data[curbyte+t]==data[curbyte+t+bytespp]);
-			}
-			curbyte += bytespp;
-			if (1==run_length) {
-				raw = !succ_eq;
-			}
-			if (raw && succ_eq) {
-				run_length--;
-				break;
-			}
-			if (!raw && !succ_eq) {
-				break;
-			}
+		const unsigned char *chunk = src+curpix*BPP;
+		unsigned long left = std::min(npixels-curpix, max_chunk_length);
+		unsigned int first = load_pixel<BPP>(chunk);
+		unsigned long run_length = 1;
+		while (run_length<left && load_pixel<BPP>(chunk+run_length*BPP)==first) {
 			run_length++;
 		}
-		curpix += run_length;
-		out.put(raw?run_length-1:run_length+127);
-		if (!out.good()) {
-			std::cerr << "can't dump the tga file\n";
-			return false;
+		if (run_length>=min_run_length) {
+			*dst++ = run_length+127;
+			memcpy(dst, chunk, BPP);
+			dst += BPP;
+			curpix += run_length;
+			continue;
 		}
-		out.write((char *)(data+chunkstart), (raw?run_length*bytespp:bytespp));
-		if (!out.good()) {
-			std::cerr << "can't dump the tga file\n";
-			return false;
+
+		// raw packet up to the first pixel that starts a run
+		unsigned long raw_length = left;
+		unsigned int prev = first;
+		unsigned long equal = 1;
+		for (unsigned long i=1; i<left; i++) {
+			unsigned int next = load_pixel<BPP>(chunk+i*BPP);
+			equal = (next==prev) ? equal+1 : 1;
+			prev = next;
+			if (equal==min_run_length) {
+				raw_length = i+1-min_run_length;
+				break;
+			}
 		}
+		*dst++ = raw_length-1;
+		memcpy(dst, chunk, raw_length*BPP);
+		dst += raw_length*BPP;
+		curpix += raw_length;
+	}
+	return dst-begin;
+}
+
+static unsigned long encode_rle(const unsigned char *src, unsigned long npixels, int bytespp, unsigned char *dst) {
+	switch (bytespp) {
+		case TGAImage::GRAYSCALE: return encode_rle<1>(src, npixels, dst);
+		case TGAImage::RGB:       return encode_rle<3>(src, npixels, dst);
+		default:                  return encode_rle<4>(src, npixels, dst);
+	}
+}
+
+// With a pool the image is cut into bands of scanlines that are encoded
+// independently and concatenated, so packets never cross a band boundary.
+void TGAImage::unload_rle_data(std::vector<unsigned char> &out, ThreadPool *pool) {
+	unsigned long npixels = (unsigned long)width*height;
+	size_t nbands = pool ? std::min((size_t)height, pool->GetThreadsCount()) : 1;
+	if (nbands<=1) {
+		size_t offset = out.size();
+		out.resize(offset+rle_bound(npixels, bytespp));
+		out.resize(offset+encode_rle(data, npixels, bytespp, &out[offset]));
+		return;
+	}
+	std::vector<std::vector<unsigned char> > bands(nbands);
+	pool->ParallelFor(nbands, [&](size_t band) {
+		unsigned long y0 = height*band/nbands;
+		unsigned long y1 = height*(band+1)/nbands;
+		unsigned long n = (y1-y0)*width;
+		bands[band].resize(rle_bound(n, bytespp));
+		bands[band].resize(encode_rle(data+y0*width*bytespp, n, bytespp, bands[band].data()));
+	});
+	for (size_t band=0; band<nbands; band++) {
+		out.insert(out.end(), bands[band].begin(), bands[band].end());
 	}
-	return true;
 }
 
 TGAColor TGAImage::get(int x, int y) {
 	if (!data || x<0 || y<0 || x>=width || y>=height) {
 		return TGAColor();
 	}
+	if (bottom_up) y = height-1-y;
 	return TGAColor(data+(x+y*width)*bytespp, bytespp);
 }
 
@@ -259,6 +463,7 @@ bool TGAImage::set(int x, int y, TGAColor c) {
 	if (!data || x<0 || y<0 || x>=width || y>=height) {
 		return false;
 	}
+	if (bottom_up) y = height-1-y;
 	memcpy(data+(x+y*width)*bytespp, c.raw, bytespp);
 	return true;
 }
@@ -275,47 +480,117 @@ int TGAImage::get_height() {
 	return height;
 }
 
+// Mirrors a row of 1-byte pixels: a register of bytes from each end is
+// loaded, reversed and stored at the other end.
+static void flip_row_gray(unsigned char *l, unsigned char *r) {
+	const long pack_bytes = simd::WIDTH*sizeof(int);
+	while (r-l>=2*pack_bytes) {
+		r -= pack_bytes;
+		simd::IntPack a = simd::Load((const int *)l);
+		simd::IntPack b = simd::Load((const int *)r);
+		simd::Store((int *)l, simd::ReverseBytes(b));
+		simd::Store((int *)r, simd::ReverseBytes(a));
+		l += pack_bytes;
+	}
+	std::reverse(l, r);
+}
+
+// Mirrors a row of 3-byte pixels. With SSSE3, five pixels (15 bytes) from
+// each end are swapped per step: the left ones are loaded with the byte
+// after them and the right ones with the byte before them, the pixels are
+// reordered with a byte shuffle and the extra bytes are stored back as they
+// were, so no pixel outside the two groups changes.
+static void flip_row_rgb(unsigned char *l, unsigned char *r) {
+#if defined(__SSSE3__)
+	const __m128i to_left = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5, 6, 1, 2, 3, -1);
+	const __m128i to_right = _mm_setr_epi8(-1, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2);
+	const __m128i last_byte = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1);
+	const __m128i first_byte = _mm_setr_epi8(-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	while (r-l>=32) {
+		r -= 15;
+		__m128i a = _mm_loadu_si128((const __m128i *)l);
+		__m128i b = _mm_loadu_si128((const __m128i *)(r-1));
+		__m128i left = _mm_or_si128(_mm_shuffle_epi8(b, to_left), _mm_and_si128(a, last_byte));
+		__m128i right = _mm_or_si128(_mm_shuffle_epi8(a, to_right), _mm_and_si128(b, first_byte));
+		_mm_storeu_si128((__m128i *)l, left);
+		_mm_storeu_si128((__m128i *)(r-1), right);
+		l += 15;
+	}
+#endif
+	for (r -= 3; l<r; l+=3, r-=3) {
+		std::swap_ranges(l, l+3, r);
+	}
+}
+
+// Mirrors every row in place: 4-byte pixels are swapped a register at a
+// time from both ends, 1- and 3-byte ones through byte reversing kernels.
 bool TGAImage::flip_horizontally() {
 	if (!data) return false;
-	int half = width>>1;
-	for (int i=0; i<half; i++) {
-		for (int j=0; j<height; j++) {
-			TGAColor c1 = get(i, j);
-			TGAColor c2 = get(width-1-i, j);
-			set(i, j, c2);
-			set(width-1-i, j, c1);
+	unsigned long bytes_per_line = width*bytespp;
+	for (int j=0; j<height; j++) {
+		unsigned char *line = data+j*bytes_per_line;
+		if (RGBA==bytespp) {
+			int *l = (int *)line;
+			int *r = l+width;
+			while (r-l>=2*simd::WIDTH) {
+				r -= simd::WIDTH;
+				simd::IntPack a = simd::Load(l);
+				simd::IntPack b = simd::Load(r);
+				simd::Store(l, simd::Reverse(b));
+				simd::Store(r, simd::Reverse(a));
+				l += simd::WIDTH;
+			}
+			std::reverse(l, r);
+		} else if (GRAYSCALE==bytespp) {
+			flip_row_gray(line, line+bytes_per_line);
+		} else {
+			flip_row_rgb(line, line+bytes_per_line);
 		}
 	}
 	return true;
 }
 
+// Only changes how rows are addressed; the pixels stay where they are.
 bool TGAImage::flip_vertically() {
 	if (!data) return false;
-	unsigned long bytes_per_line = width*bytespp;
-	unsigned char *line = new unsigned char[bytes_per_line];
-	int half = height>>1;
-	for (int j=0; j<half; j++) {
-		unsigned long l1 = j*bytes_per_line;
-		unsigned long l2 = (height-1-j)*bytes_per_line;
-		memmove((void *)line,      (void *)(data+l1), bytes_per_line);
-		memmove((void *)(data+l1), (void *)(data+l2), bytes_per_line);
-		memmove((void *)(data+l2), (void *)line,      bytes_per_line);
-	}
-	delete [] line;
+	bottom_up = !bottom_up;
 	return true;
 }
 
+bool TGAImage::is_bottom_up() {
+	return bottom_up;
+}
+
 unsigned char *TGAImage::buffer() {
 	return data;
 }
 
+TGAView TGAImage::view() {
+	long stride = (long)width*bytespp;
+	if (bottom_up && data) {
+		return TGAView(data+(height-1)*stride, width, height, bytespp, -stride);
+	}
+	return TGAView(data, width, height, bytespp, stride);
+}
+
+TGAView TGAImage::view(int x, int y, int w, int h) {
+	return view().sub(x, y, w, h);
+}
+
 void TGAImage::clear() {
 	memset((void *)data, 0, width*height*bytespp);
 }
 
-bool TGAImage::scale(int w, int h) {
+bool TGAImage::scale(int w, int h, Filter filter, ThreadPool *pool) {
 	if (w<=0 || h<=0 || !data) return false;
-	unsigned char *tdata = new unsigned char[w*h*bytespp];
+	if (NEAREST!=filter) {
+		TGAImage scaled(w, h, bytespp);
+		if (!resample(view(), scaled.view(), filter, pool)) return false;
+		*this = std::move(scaled);
+		return true;
+	}
+	PixelBuffer tbuffer = acquire_pixels(w*h*bytespp);
+	unsigned char *tdata = align_pixels(tbuffer.allocation);
 	int nscanline = 0;
 	int oscanline = 0;
 	int erry = 0;
@@ -343,7 +618,9 @@ bool TGAImage::scale(int w, int h) {
 			nscanline += nlinebytes;
 		}
 	}
-	delete [] data;
+	release();
+	allocation = tbuffer.allocation;
+	capacity = tbuffer.capacity;
 	data = tdata;
 	width = w;
 	height = h;
@@ -2,6 +2,9 @@
 #define __IMAGE_H__
 
 #include <fstream>
+#include <vector>
+
+class ThreadPool;
 
 #pragma pack(push,1)
 struct TGA_Header {
@@ -60,36 +63,89 @@ struct TGAColor {
 };
 
 
+// Non-owning window into the pixels of an image. Rows are 'stride' bytes
+// apart, so a view of a sub-rectangle shares the pixels of its image and
+// stays valid only as long as that image keeps its buffer.
+struct TGAView {
+	unsigned char *data;
+	int width;
+	int height;
+	int bytespp;
+	long stride;
+
+	TGAView() : data(NULL), width(0), height(0), bytespp(0), stride(0) {
+	}
+
+	TGAView(unsigned char *d, int w, int h, int bpp, long s) : data(d), width(w), height(h), bytespp(bpp), stride(s) {
+	}
+
+	unsigned char *row(int y) const {
+		return data+y*stride;
+	}
+
+	TGAColor get(int x, int y) const {
+		if (!data || x<0 || y<0 || x>=width || y>=height) {
+			return TGAColor();
+		}
+		return TGAColor(row(y)+x*bytespp, bytespp);
+	}
+
+	bool set(int x, int y, TGAColor c) const;
+	// Sub-rectangle of this view, clipped to it.
+	TGAView sub(int x, int y, int w, int h) const;
+};
+
+
 class TGAImage {
 protected:
 	unsigned char* data;
+	// owning pointer and size of the pooled buffer 'data' is aligned into
+	unsigned char* allocation;
+	unsigned long capacity;
 	int width;
 	int height;
 	int bytespp;
+	// rows are stored bottom to top; flip_vertically only toggles this
+	bool bottom_up;
+
+	void allocate(unsigned long nbytes);
+	void release();
 
 	bool   load_rle_data(std::ifstream &in);
-	bool unload_rle_data(std::ofstream &out);
+	void unload_rle_data(std::vector<unsigned char> &out, ThreadPool *pool);
 public:
 	enum Format {
 		GRAYSCALE=1, RGB=3, RGBA=4
 	};
+	// NEAREST is the original in-place scaler, the others go through resample()
+	enum Filter {
+		NEAREST, BOX, BILINEAR, BICUBIC
+	};
 
 	TGAImage();
 	TGAImage(int w, int h, int bpp);
 	TGAImage(const TGAImage &img);
+	TGAImage(TGAImage &&img);
+	// Deep copy of the pixels seen through 'view'.
+	explicit TGAImage(const TGAView &view);
 	bool read_tga_file(const char *filename);
-	bool write_tga_file(const char *filename, bool rle=true);
+	bool write_tga_file(const char *filename, bool rle=true, ThreadPool *pool=NULL);
 	bool flip_horizontally();
 	bool flip_vertically();
-	bool scale(int w, int h);
+	bool scale(int w, int h, Filter filter=NEAREST, ThreadPool *pool=NULL);
 	TGAColor get(int x, int y);
 	bool set(int x, int y, TGAColor c);
 	~TGAImage();
 	TGAImage & operator =(const TGAImage &img);
+	TGAImage & operator =(TGAImage &&img);
 	int get_width();
 	int get_height();
 	int get_bytespp();
+	bool is_bottom_up();
+	// Raw storage; row y of the image is row height-1-y here when bottom_up.
 	unsigned char *buffer();
+	TGAView view();
+	TGAView view(int x, int y, int w, int h);
 	void clear();
 };
 
@@ -0,0 +1,99 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(std::size_t threads_count)
+    : _Task(nullptr), _Count(0), _Next(0), _Busy(0), _Generation(0), _Stop(false)
+{
+    if (threads_count == 0)
+    {
+        threads_count = std::thread::hardware_concurrency();
+    }
+    for (std::size_t i = 1; i < threads_count; i++)
+    {
+        _Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_Mutex);
+        _Stop = true;
+    }
+    _WakeUp.notify_all();
+    for (std::thread &worker : _Workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(std::size_t count, const std::function<void(std::size_t)> &task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (_Workers.empty() || count == 1)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_Mutex);
+    _Task = &task;
+    _Count = count;
+    _Next = 0;
+    // added, not stored: a worker that woke late for the previous job may
+    // already be counted and still inside RunTasks()
+    _Busy += 1;
+    _Generation++;
+    lock.unlock();
+    _WakeUp.notify_all();
+
+    RunTasks();
+
+    lock.lock();
+    _Busy--;
+    _Done.wait(lock, [this]() { return _Busy == 0; });
+    _Task = nullptr;
+}
+
+void ThreadPool::RunTasks()
+{
+    std::unique_lock<std::mutex> lock(_Mutex);
+    while (_Next < _Count)
+    {
+        std::size_t index = _Next++;
+        const std::function<void(std::size_t)> &task = *_Task;
+        lock.unlock();
+        task(index);
+        lock.lock();
+    }
+}
+
+void ThreadPool::WorkerLoop()
+{
+    unsigned long seen_generation = 0;
+    std::unique_lock<std::mutex> lock(_Mutex);
+    while (true)
+    {
+        _WakeUp.wait(lock, [&]() { return _Stop || _Generation != seen_generation; });
+        if (_Stop)
+        {
+            return;
+        }
+        seen_generation = _Generation;
+        _Busy++;
+        lock.unlock();
+
+        RunTasks();
+
+        lock.lock();
+        if (--_Busy == 0)
+        {
+            _Done.notify_all();
+        }
+    }
+}
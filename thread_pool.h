@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads executing parallel-for style jobs.
+// The calling thread takes part in every job, so a pool of size 1 has no
+// workers and simply runs the job inline.
+class ThreadPool
+{
+    public:
+        explicit ThreadPool(std::size_t threads_count = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        std::size_t GetThreadsCount() const { return _Workers.size() + 1; }
+
+        // Calls 'task(i)' for every i in [0, count) and returns when all calls
+        // have finished. Indices are handed out dynamically.
+        void ParallelFor(std::size_t count, const std::function<void(std::size_t)> &task);
+
+    private:
+        void WorkerLoop();
+        void RunTasks();
+
+        std::vector<std::thread> _Workers;
+        std::mutex _Mutex;
+        std::condition_variable _WakeUp;
+        std::condition_variable _Done;
+
+        const std::function<void(std::size_t)> *_Task;
+        std::size_t _Count;
+        std::size_t _Next;
+        std::size_t _Busy;
+        unsigned long _Generation;
+        bool _Stop;
+};
@@ -0,0 +1,50 @@
+// Stress test of ThreadPool::ParallelFor: thousands of short jobs back to
+// back, each with its own task and output on the caller's stack, so a worker
+// still running the previous job when the next one starts shows up as a
+// wrong count, a crash under the sanitizers or a hang.
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "thread_pool.h"
+
+static
+bool stress(std::size_t threads_count, unsigned long jobs)
+{
+    ThreadPool pool(threads_count);
+    for (unsigned long job = 0; job < jobs; job++)
+    {
+        std::size_t count = 1 + job % (2 * pool.GetThreadsCount() + 1);
+        std::vector<std::atomic<int> > calls(count);
+        for (std::atomic<int> &c : calls)
+        {
+            c = 0;
+        }
+        pool.ParallelFor(count, [&calls](std::size_t i) { calls[i]++; });
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            if (calls[i] != 1)
+            {
+                std::cerr << threads_count << " threads, job " << job << ": task " << i << " ran "
+                          << calls[i] << " times" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long jobs = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    bool passed = true;
+    for (std::size_t threads_count : {2, 3, 8, 0})
+    {
+        passed = stress(threads_count, jobs) && passed;
+    }
+    std::cerr << (passed ? "passed" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include "tile_renderer.h"
+#include "profiler.h"
+
+TileRenderer::TileRenderer(ThreadPool &pool, long width, long height, long tile_size)
+    : _Pool(pool), _Width(width), _Height(height)
+{
+    // tiles own whole depth blocks: DepthBuffer resets and HierarchicalZ
+    // updates a block at a time, so one shared between two tiles would be
+    // written by two workers
+    static_assert(DepthBuffer::BLOCK_SIZE == HierarchicalZ::BLOCK_SIZE,
+                  "tiles are aligned to a block size shared by DepthBuffer and HierarchicalZ");
+    const long block_size = HierarchicalZ::BLOCK_SIZE;
+    _TileSize = (tile_size + block_size - 1) / block_size * block_size;
+    _TilesX = (_Width + _TileSize - 1) / _TileSize;
+    _TilesY = (_Height + _TileSize - 1) / _TileSize;
+    _Bins.resize(_TilesX * _TilesY);
+    _Occluded.resize(_Bins.size());
+}
+
+Rect TileRenderer::GetTileRect(std::size_t tile) const
+{
+    long tx = tile % _TilesX;
+    long ty = tile / _TilesX;
+    return Rect(tx * _TileSize, ty * _TileSize,
+                std::min((tx + 1) * _TileSize, _Width), std::min((ty + 1) * _TileSize, _Height));
+}
+
+void TileRenderer::Bin(const std::vector<ScreenTriangle> &triangles, RasterMode mode)
+{
+    for (std::vector<unsigned> &bin : _Bins)
+    {
+        bin.clear();
+    }
+    _Overlaps.assign(triangles.size(), 0);
+
+    for (std::size_t i = 0; i < triangles.size(); i++)
+    {
+        Rect bounds = get_bounds(triangles[i], mode);
+        if (bounds.Empty() || bounds.x1 <= 0 || bounds.y1 <= 0 || bounds.x0 >= _Width || bounds.y0 >= _Height)
+        {
+            PROFILE_COUNT(TRIANGLES_CULLED, 1);
+            continue;
+        }
+
+        long tx0 = std::max(bounds.x0, 0L) / _TileSize;
+        long ty0 = std::max(bounds.y0, 0L) / _TileSize;
+        long tx1 = std::min(bounds.x1 - 1, _Width - 1) / _TileSize;
+        long ty1 = std::min(bounds.y1 - 1, _Height - 1) / _TileSize;
+        for (long ty = ty0; ty <= ty1; ty++)
+        {
+            for (long tx = tx0; tx <= tx1; tx++)
+            {
+                _Bins[ty * _TilesX + tx].push_back(i);
+            }
+        }
+        _Overlaps[i] = (tx1 - tx0 + 1) * (ty1 - ty0 + 1);
+    }
+}
+
+void TileRenderer::ForEachTile(const std::vector<ScreenTriangle> &triangles, RasterMode mode,
+                               const std::function<void(unsigned, const Rect &)> &draw)
+{
+    Bin(triangles, mode);
+
+    _Pool.ParallelFor(_Bins.size(), [&](std::size_t tile)
+    {
+        Rect clip = GetTileRect(tile);
+        for (unsigned index : _Bins[tile])
+        {
+            draw(index, clip);
+        }
+    });
+}
+
+void TileRenderer::Render(TGAImage &image, DepthBuffer &zbuffer, Vector3f &light, const std::vector<ScreenTriangle> &triangles,
+                          const std::vector<const Texture *> &textures, RasterMode mode, HierarchicalZ *hiz)
+{
+    for (std::vector<unsigned> &occluded : _Occluded)
+    {
+        occluded.clear();
+    }
+    ForEachTile(triangles, mode, [&](unsigned index, const Rect &clip)
+    {
+        if (rasterize(mode, image, triangles[index], zbuffer, *textures[index], light, clip, hiz))
+        {
+            _Occluded[(clip.y0 / _TileSize) * _TilesX + clip.x0 / _TileSize].push_back(index);
+        }
+    });
+
+    // a triangle is culled when every tile it overlaps rejected it
+    unsigned long culled = 0;
+    for (const std::vector<unsigned> &occluded : _Occluded)
+    {
+        for (unsigned index : occluded)
+        {
+            culled += (--_Overlaps[index] == 0);
+        }
+    }
+    if (culled)
+    {
+        hiz->AddCulled(culled, 0);
+        PROFILE_COUNT(TRIANGLES_CULLED, culled);
+    }
+}
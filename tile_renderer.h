@@ -0,0 +1,49 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "rasterizer.h"
+#include "thread_pool.h"
+
+// Bins triangles into square screen tiles and rasterizes the tiles in
+// parallel. Every tile owns its pixels of the image and the z-buffer, so the
+// workers never need to synchronize, and triangles inside a tile are drawn in
+// submission order, which keeps the result identical to the serial path.
+class TileRenderer
+{
+    public:
+        // 'tile_size' is rounded up to a multiple of the block size of
+        // DepthBuffer and HierarchicalZ, so that no block of the depth buffer
+        // or of its bounds is shared between two tiles.
+        TileRenderer(ThreadPool &pool, long width, long height, long tile_size = 64);
+
+        // Draws 'triangles[i]' with the texture 'textures[i]'.
+        void Render(TGAImage &image, DepthBuffer &zbuffer, Vector3f &light, const std::vector<ScreenTriangle> &triangles,
+                    const std::vector<const Texture *> &textures, RasterMode mode = RASTER_SCANLINE,
+                    HierarchicalZ *hiz = nullptr);
+
+        // Bins 'triangles' and calls 'draw(index, tile)' for every triangle
+        // overlapping a tile, with the tile's rectangle. Tiles run in
+        // parallel, the triangles of a tile in submission order.
+        void ForEachTile(const std::vector<ScreenTriangle> &triangles, RasterMode mode,
+                         const std::function<void(unsigned, const Rect &)> &draw);
+
+        std::size_t GetTilesCount() const { return _Bins.size(); }
+        Rect GetTileRect(std::size_t tile) const;
+        ThreadPool &GetPool() const { return _Pool; }
+
+    private:
+        void Bin(const std::vector<ScreenTriangle> &triangles, RasterMode mode);
+
+        ThreadPool &_Pool;
+        long _Width;
+        long _Height;
+        long _TileSize;
+        long _TilesX;
+        long _TilesY;
+        std::vector<std::vector<unsigned> > _Bins;
+        // Number of tiles every triangle was binned to, and the triangles
+        // hierarchical z rejected in each tile.
+        std::vector<unsigned> _Overlaps;
+        std::vector<std::vector<unsigned> > _Occluded;
+};
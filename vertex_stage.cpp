@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <unordered_map>
+#include "vertex_stage.h"
+#include "profiler.h"
+
+namespace
+{
+
+struct VertexKey
+{
+    std::uint32_t v;
+    std::uint32_t vt;
+    std::uint32_t vn;
+
+    bool operator==(const VertexKey &k) const { return v == k.v && vt == k.vt && vn == k.vn; }
+};
+
+struct VertexKeyHash
+{
+    std::size_t operator()(const VertexKey &k) const
+    {
+        std::uint64_t h = k.v * 0x9e3779b97f4a7c15ULL;
+        h ^= (k.vt + 0x7f4a7c15ULL) * 0xbf58476d1ce4e5b9ULL;
+        h ^= (k.vn + 0x1ce4e5b9ULL) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+};
+
+// Vertices with a smaller w are treated as behind the eye. Anything closer
+// would be magnified past the range of the screen coordinates.
+const float NEAR_W = 1e-3f;
+
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+float vertex_score(int cache_position, std::uint32_t remaining, std::size_t cache_size)
+{
+    if (remaining == 0)
+    {
+        return -1.f;
+    }
+    float score = 0.f;
+    if (cache_position >= 0)
+    {
+        if (cache_position < 3)
+        {
+            // the vertices of the last triangle get a fixed score, so that
+            // the next triangle does not simply reuse its edge
+            score = LAST_TRIANGLE_SCORE;
+        }
+        else
+        {
+            float scale = 1.f / (cache_size - 3);
+            score = std::pow(1.f - (cache_position - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+    return score + VALENCE_BOOST_SCALE * std::pow((float)remaining, -VALENCE_BOOST_POWER);
+}
+
+}
+
+VertexStage::VertexStage(const ObjModel &model)
+{
+    PROFILE_SCOPE(STAGE_VERTEX);
+    const MeshArrays &mesh = model.GetMeshArrays();
+    std::size_t corners = mesh.face_v.size();
+
+    std::unordered_map<VertexKey, std::uint32_t, VertexKeyHash> welded;
+    welded.reserve(corners / 2);
+    _Indices.reserve(corners);
+    for (std::size_t i = 0; i < corners; i++)
+    {
+        VertexKey key = {mesh.face_v[i], mesh.face_vt[i], mesh.face_vn[i]};
+        std::pair<std::unordered_map<VertexKey, std::uint32_t, VertexKeyHash>::iterator, bool> inserted =
+            welded.insert(std::make_pair(key, (std::uint32_t)_SourceV.size()));
+        if (inserted.second)
+        {
+            _SourceV.push_back(key.v);
+            _SourceVt.push_back(key.vt);
+            _SourceVn.push_back(key.vn);
+        }
+        _Indices.push_back(inserted.first->second);
+    }
+
+    std::size_t count = _SourceV.size();
+    _Positions.resize(count);
+    _SourceNormals.resize(count);
+    _SourceTextures.resize(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        Vector3f position = model.GetVertexGeometric(_SourceV[i]);
+        Vector3f normal = (_SourceVn[i] == ObjModel::NO_INDEX) ? Vector3f() : model.GetVertexNormal(_SourceVn[i]);
+        _SourceTextures[i] = (_SourceVt[i] == ObjModel::NO_INDEX) ? Vector2f() : model.GetVertexTexture(_SourceVt[i]);
+        _Positions.x[i] = position.x;
+        _Positions.y[i] = position.y;
+        _Positions.z[i] = position.z;
+        _SourceNormals.x[i] = normal.x;
+        _SourceNormals.y[i] = normal.y;
+        _SourceNormals.z[i] = normal.z;
+    }
+}
+
+void VertexStage::Transform(const Matrix4 &to_screen, const Matrix4 &to_world, const Texture &texture)
+{
+    PROFILE_SCOPE(STAGE_VERTEX);
+    transform_points(to_screen, _Positions, _ScreenPositions, &_W);
+    transform_directions(to_world.normal_matrix(), _SourceNormals, _WorldNormals);
+
+    std::size_t count = _SourceV.size();
+    _Screen.resize(count);
+    _Subpixel.resize(count);
+    _Normals.resize(count);
+    _Textures.resize(count);
+    _InFront.resize(count);
+    const int texture_width = texture.GetWidth(), texture_height = texture.GetHeight();
+    for (std::size_t i = 0; i < count; i++)
+    {
+        float x = _ScreenPositions.x[i];
+        float y = _ScreenPositions.y[i];
+        _InFront[i] = _W[i] > NEAR_W;
+        if (!_InFront[i])
+        {
+            continue;
+        }
+        _Screen[i] = Vector3l(std::lround(x), std::lround(y), std::lround(_ScreenPositions.z[i]));
+        _Subpixel[i] = Vector2l(std::lround(x * SUBPIXEL_SCALE), std::lround(y * SUBPIXEL_SCALE));
+        _Normals[i] = Vector3f(_WorldNormals.x[i], _WorldNormals.y[i], _WorldNormals.z[i]);
+        _Textures[i] = (_SourceVt[i] == ObjModel::NO_INDEX) ? Vector2l() :
+                       Vector2l(std::round(_SourceTextures[i].x * texture_width),
+                                std::round(_SourceTextures[i].y * texture_height));
+    }
+}
+
+void StreamVertexStage::Transform(const Matrix4 &to_screen, const Matrix4 &to_world, const Texture &texture)
+{
+    PROFILE_SCOPE(STAGE_VERTEX);
+    transform_points(to_screen, _Stream.GetVertices(), _ScreenPositions, &_W);
+    transform_directions(to_world.normal_matrix(), _Stream.GetNormals(), _WorldNormals);
+    _TextureWidth = texture.GetWidth();
+    _TextureHeight = texture.GetHeight();
+
+    _InFront.resize(_W.size());
+    for (std::size_t i = 0; i < _W.size(); i++)
+    {
+        _InFront[i] = _W[i] > NEAR_W;
+    }
+}
+
+float VertexStage::GetAcmr(const std::vector<std::uint32_t> &indices, std::size_t cache_size)
+{
+    if (indices.empty())
+    {
+        return 0.f;
+    }
+    std::deque<std::uint32_t> cache;
+    unsigned long misses = 0;
+    for (std::uint32_t index : indices)
+    {
+        if (std::find(cache.begin(), cache.end(), index) == cache.end())
+        {
+            misses++;
+            cache.push_front(index);
+            if (cache.size() > cache_size)
+            {
+                cache.pop_back();
+            }
+        }
+    }
+    return (float)misses / (indices.size() / 3);
+}
+
+void VertexStage::OptimizeVertexCache(std::size_t cache_size, float *p_acmrBefore, float *p_acmrAfter)
+{
+    PROFILE_SCOPE(STAGE_VERTEX);
+    if (p_acmrBefore)
+    {
+        *p_acmrBefore = GetAcmr(_Indices, cache_size);
+    }
+
+    const std::size_t vertices = _SourceV.size();
+    const std::size_t triangles = _Indices.size() / 3;
+    if (cache_size < 4 || triangles == 0)
+    {
+        if (p_acmrAfter)
+        {
+            *p_acmrAfter = GetAcmr(_Indices, cache_size);
+        }
+        return;
+    }
+
+    // Vertex -> triangles adjacency in compressed rows.
+    std::vector<std::uint32_t> remaining(vertices, 0);
+    for (std::uint32_t index : _Indices)
+    {
+        remaining[index]++;
+    }
+    std::vector<std::uint32_t> adjacency_offsets(vertices + 1, 0);
+    for (std::size_t v = 0; v < vertices; v++)
+    {
+        adjacency_offsets[v + 1] = adjacency_offsets[v] + remaining[v];
+    }
+    std::vector<std::uint32_t> adjacency(_Indices.size());
+    {
+        std::vector<std::uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        for (std::size_t i = 0; i < _Indices.size(); i++)
+        {
+            adjacency[fill[_Indices[i]]++] = i / 3;
+        }
+    }
+
+    std::vector<int> cache_position(vertices, -1);
+    std::vector<float> score(vertices);
+    for (std::size_t v = 0; v < vertices; v++)
+    {
+        score[v] = vertex_score(-1, remaining[v], cache_size);
+    }
+
+    std::vector<bool> emitted(triangles, false);
+    std::vector<std::uint32_t> cache;
+    std::vector<std::uint32_t> next_cache;
+    cache.reserve(cache_size + 3);
+    next_cache.reserve(cache_size + 3);
+
+    std::vector<std::uint32_t> result;
+    result.reserve(_Indices.size());
+
+    std::size_t scan_cursor = 0;
+    long best = -1;
+    while (result.size() < _Indices.size())
+    {
+        if (best < 0)
+        {
+            // nothing left around the cached vertices: continue with the
+            // first triangle not emitted yet, which keeps this pass linear
+            for (; emitted[scan_cursor]; scan_cursor++)
+            {
+            }
+            best = scan_cursor;
+        }
+
+        const std::uint32_t *corners = &_Indices[3 * best];
+        emitted[best] = true;
+        result.insert(result.end(), corners, corners + 3);
+
+        // the emitted triangle goes to the front of the LRU cache
+        next_cache.assign(corners, corners + 3);
+        for (std::uint32_t v : cache)
+        {
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+            {
+                next_cache.push_back(v);
+            }
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            std::uint32_t v = corners[k];
+            remaining[v]--;
+            std::uint32_t *list = &adjacency[adjacency_offsets[v]];
+            std::uint32_t *list_end = list + remaining[v] + 1;
+            *std::find(list, list_end, (std::uint32_t)best) = list_end[-1];
+        }
+
+        for (std::size_t i = cache_size; i < next_cache.size(); i++)
+        {
+            std::uint32_t v = next_cache[i];
+            cache_position[v] = -1;
+            score[v] = vertex_score(-1, remaining[v], cache_size);
+        }
+        if (next_cache.size() > cache_size)
+        {
+            next_cache.resize(cache_size);
+        }
+        cache.swap(next_cache);
+
+        // rescore the cached vertices and the triangles using them
+        for (std::size_t i = 0; i < cache.size(); i++)
+        {
+            cache_position[cache[i]] = i;
+        }
+        for (std::uint32_t v : cache)
+        {
+            score[v] = vertex_score(cache_position[v], remaining[v], cache_size);
+        }
+
+        best = -1;
+        float best_score = -1.f;
+        for (std::uint32_t v : cache)
+        {
+            for (std::uint32_t i = 0; i < remaining[v]; i++)
+            {
+                std::uint32_t t = adjacency[adjacency_offsets[v] + i];
+                float s = score[_Indices[3 * t]] + score[_Indices[3 * t + 1]] + score[_Indices[3 * t + 2]];
+                if (s > best_score)
+                {
+                    best_score = s;
+                    best = t;
+                }
+            }
+        }
+    }
+
+    _Indices.swap(result);
+    if (p_acmrAfter)
+    {
+        *p_acmrAfter = GetAcmr(_Indices, cache_size);
+    }
+}
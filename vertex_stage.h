@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "geometry.h"
+#include "obj_model.h"
+#include "obj_stream.h"
+#include "rasterizer.h"
+
+// Indexed vertex processing. Every distinct (v, vt, vn) corner of the model
+// is welded into one vertex, triangles refer to vertices through an index
+// buffer, and Transform() processes each vertex once into post-transform
+// arrays that the triangle assembly reads from. Everything Transform() reads
+// is copied out of the model on construction, so one stage serves every
+// instance of a mesh.
+class VertexStage
+{
+    public:
+        explicit VertexStage(const ObjModel &model);
+
+        std::size_t GetVerticesCount() const  { return _SourceV.size(); }
+        std::size_t GetTrianglesCount() const { return _Indices.size() / 3; }
+        const std::vector<std::uint32_t> &GetIndices() const { return _Indices; }
+
+        // Reorders the triangles for a FIFO/LRU post-transform cache of
+        // 'cache_size' entries, following Tom Forsyth's linear-speed vertex
+        // cache optimisation. Returns the average cache miss ratio (misses
+        // per triangle) before and after.
+        void OptimizeVertexCache(std::size_t cache_size, float *p_acmrBefore = nullptr, float *p_acmrAfter = nullptr);
+
+        // Maps every vertex to the screen with 'to_screen' (model, view,
+        // projection and viewport in one matrix) in a single batched pass,
+        // and its normal to world space with the normal matrix of 'to_world'.
+        // x and y are kept both rounded and in subpixel fixed point, z is
+        // rounded; depths outside the viewport's range are left to the clipper.
+        // Texture coordinates are scaled to texels of 'texture'.
+        void Transform(const Matrix4 &to_screen, const Matrix4 &to_world, const Texture &texture);
+
+        // Fills 't' with triangle 'i'. Returns false, leaving 't' undefined,
+        // when a corner is at or behind the eye: the projection can not map
+        // it to the screen, so such triangles are rejected whole rather than
+        // clipped.
+        bool AssembleTriangle(std::size_t i, ScreenTriangle &t) const
+        {
+            const std::uint32_t *corners = &_Indices[3 * i];
+            if (!(_InFront[corners[0]] && _InFront[corners[1]] && _InFront[corners[2]]))
+            {
+                return false;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                t.v[k] = _Screen[corners[k]];
+                t.p[k] = _Subpixel[corners[k]];
+                t.n[k] = _Normals[corners[k]];
+                t.u[k] = _Textures[corners[k]];
+            }
+            return true;
+        }
+
+        static float GetAcmr(const std::vector<std::uint32_t> &indices, std::size_t cache_size);
+
+    private:
+        // Source indices of each welded vertex.
+        std::vector<std::uint32_t> _SourceV;
+        std::vector<std::uint32_t> _SourceVt;
+        std::vector<std::uint32_t> _SourceVn;
+
+        std::vector<std::uint32_t> _Indices;
+
+        // Model space positions, normals and texture coordinates of the
+        // welded vertices.
+        Vector3Array _Positions;
+        Vector3Array _SourceNormals;
+        std::vector<Vector2f> _SourceTextures;
+        // Scratch output of the batched transforms.
+        Vector3Array _ScreenPositions;
+        Vector3Array _WorldNormals;
+        std::vector<float> _W;
+
+        // Post-transform vertices.
+        std::vector<Vector3l> _Screen;
+        std::vector<Vector2l> _Subpixel;
+        std::vector<Vector3f> _Normals;
+        std::vector<Vector2l> _Textures;
+        std::vector<unsigned char> _InFront;
+};
+
+// Vertex processing for a mesh read chunk by chunk from an ObjStream. With
+// no index buffer to weld corners by, positions and normals are transformed
+// as the separate arrays of the file and every triangle is assembled from
+// the (v, vt, vn) indices of its corners, rounding to the screen per corner.
+// The triangles are the ones VertexStage produces for the same mesh.
+class StreamVertexStage
+{
+    public:
+        explicit StreamVertexStage(const ObjStream &stream) : _Stream(stream), _TextureWidth(0), _TextureHeight(0) {};
+
+        // Same as VertexStage::Transform().
+        void Transform(const Matrix4 &to_screen, const Matrix4 &to_world, const Texture &texture);
+
+        // Fills 't' with triangle 'i' of 'chunk', see
+        // VertexStage::AssembleTriangle().
+        bool AssembleTriangle(const ObjChunk &chunk, std::size_t i, ScreenTriangle &t) const
+        {
+            const std::uint32_t *v = &chunk.face_v[3 * i];
+            const std::uint32_t *vt = &chunk.face_vt[3 * i];
+            const std::uint32_t *vn = &chunk.face_vn[3 * i];
+            if (!(_InFront[v[0]] && _InFront[v[1]] && _InFront[v[2]]))
+            {
+                return false;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                float x = _ScreenPositions.x[v[k]];
+                float y = _ScreenPositions.y[v[k]];
+                t.v[k] = Vector3l(std::lround(x), std::lround(y), std::lround(_ScreenPositions.z[v[k]]));
+                t.p[k] = Vector2l(std::lround(x * SUBPIXEL_SCALE), std::lround(y * SUBPIXEL_SCALE));
+                t.n[k] = (vn[k] == ObjModel::NO_INDEX) ? Vector3f() :
+                         Vector3f(_WorldNormals.x[vn[k]], _WorldNormals.y[vn[k]], _WorldNormals.z[vn[k]]);
+                t.u[k] = (vt[k] == ObjModel::NO_INDEX) ? Vector2l() :
+                         Vector2l(std::round(_Stream.GetTextures()[vt[k]].x * _TextureWidth),
+                                  std::round(_Stream.GetTextures()[vt[k]].y * _TextureHeight));
+            }
+            return true;
+        }
+
+    private:
+        const ObjStream &_Stream;
+        int _TextureWidth;
+        int _TextureHeight;
+
+        // Output of the batched transforms, indexed like the file's arrays.
+        Vector3Array _ScreenPositions;
+        Vector3Array _WorldNormals;
+        std::vector<float> _W;
+        std::vector<unsigned char> _InFront;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Per-pixel id of the visible triangle, written by the depth pass of the
+// deferred renderer and read by its shading pass.
+class VisibilityBuffer
+{
+    public:
+        static const std::uint32_t EMPTY = 0xffffffffu;
+
+        VisibilityBuffer(long width, long height)
+            : _Width(width), _Height(height), _Ids((std::size_t)width * height, std::uint32_t(EMPTY)) {};
+
+        long GetWidth() const  { return _Width; }
+        long GetHeight() const { return _Height; }
+
+        std::uint32_t Get(long x, long y) const    { return _Ids[y * _Width + x]; }
+        void Set(long x, long y, std::uint32_t id) { _Ids[y * _Width + x] = id; }
+
+        // Empties the rectangle [x0, x1) x [y0, y1), so that disjoint
+        // rectangles may be cleared concurrently.
+        void Clear(long x0, long y0, long x1, long y1)
+        {
+            for (long y = y0; y < y1; y++)
+            {
+                std::fill(_Ids.begin() + y * _Width + x0, _Ids.begin() + y * _Width + x1, std::uint32_t(EMPTY));
+            }
+        }
+
+    private:
+        long _Width;
+        long _Height;
+        std::vector<std::uint32_t> _Ids;
+};